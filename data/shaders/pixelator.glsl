@@ -0,0 +1,31 @@
+#ifdef GL_ES
+precision mediump float;
+#endif
+
+uniform sampler2D al_tex;
+uniform vec2 size;
+uniform vec2 extent; // of the bitmap within its texture, which may be padded
+uniform vec3 background;
+uniform float fade;
+uniform float zoom;
+varying vec2 varying_texcoord;
+varying vec2 varying_position;
+
+void main() {
+	// snap to the texels of the low resolution text bitmap, in 0..1 over the bitmap
+	vec2 texel = (floor(varying_texcoord / extent * size) + 0.5) / size;
+	// scaled around the center by (1 + zoom / 10)
+	vec2 uv = (texel - 0.5) / (1.0 + 0.1 * zoom) + 0.5;
+	vec4 text = vec4(0.0);
+	if (uv.x >= 0.0 && uv.y >= 0.0 && uv.x <= 1.0 && uv.y <= 1.0) {
+		text = texture2D(al_tex, uv * extent) * fade;
+	}
+	vec3 color = text.rgb + background * (1.0 - text.a);
+
+	// darken every other pixel in both directions
+	vec2 pixel = floor(varying_position * size);
+	if (mod(pixel.x, 2.0) < 0.5 && mod(pixel.y, 2.0) < 0.5) {
+		color *= 1.0 - 64.0 / 255.0;
+	}
+	gl_FragColor = vec4(color, 1.0);
+}
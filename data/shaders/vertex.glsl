@@ -0,0 +1,23 @@
+attribute vec4 al_pos;
+attribute vec4 al_color;
+attribute vec2 al_texcoord;
+uniform mat4 al_projview_matrix;
+uniform bool al_use_tex_matrix;
+uniform mat4 al_tex_matrix;
+uniform vec2 viewport;
+varying vec4 varying_color;
+varying vec2 varying_texcoord;
+varying vec2 varying_position;
+
+void main() {
+	varying_color = al_color;
+	if (al_use_tex_matrix) {
+		vec4 uv = al_tex_matrix * vec4(al_texcoord, 0.0, 1.0);
+		varying_texcoord = uv.xy;
+	} else {
+		varying_texcoord = al_texcoord;
+	}
+	// 0..1 over the drawn area, top to bottom regardless of how the texture is stored
+	varying_position = al_pos.xy / viewport;
+	gl_Position = al_projview_matrix * al_pos;
+}
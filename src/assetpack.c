@@ -0,0 +1,330 @@
+/*! \file assetpack.c
+ *  \brief Single-file asset pack served to Allegro straight from memory.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "assetpack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif !defined(__EMSCRIPTEN__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ASSET_PACK_MMAP
+#endif
+
+static bool Validate(struct AssetPack* pack) {
+	if (pack->size < sizeof(struct AssetPackHeader)) {
+		return false;
+	}
+	pack->header = pack->data;
+	if ((memcmp(pack->header->magic, ASSET_PACK_MAGIC, sizeof(pack->header->magic)) != 0) || (pack->header->version != ASSET_PACK_VERSION)) {
+		return false;
+	}
+	if (sizeof(struct AssetPackHeader) + (uint64_t)pack->header->count * sizeof(struct AssetPackEntry) > pack->size) {
+		return false;
+	}
+	pack->entries = (struct AssetPackEntry*)(pack->header + 1);
+	for (uint32_t i = 0; i < pack->header->count; i++) {
+		struct AssetPackEntry* entry = &pack->entries[i];
+		if ((entry->offset > pack->size) || (entry->size > pack->size - entry->offset) || (entry->offset % ASSET_PACK_ALIGNMENT)) {
+			return false;
+		}
+		// lookups are a binary search over NUL-terminated names
+		if (entry->name[sizeof(entry->name) - 1] || ((i > 0) && (strcmp(pack->entries[i - 1].name, entry->name) >= 0))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+struct AssetPack* OpenAssetPack(const char* path) {
+	if (!path) {
+		return NULL;
+	}
+	struct AssetPack* pack = calloc(1, sizeof(struct AssetPack));
+#if defined(_WIN32)
+	pack->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (pack->file == INVALID_HANDLE_VALUE) {
+		free(pack);
+		return NULL;
+	}
+	LARGE_INTEGER size;
+	GetFileSizeEx(pack->file, &size);
+	pack->size = size.QuadPart;
+	pack->mapping = CreateFileMappingA(pack->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	pack->data = pack->mapping ? MapViewOfFile(pack->mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+#elif defined(ASSET_PACK_MMAP)
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if ((fd < 0) || (fstat(fd, &st) != 0) || (st.st_size == 0)) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		free(pack);
+		return NULL;
+	}
+	pack->size = st.st_size;
+	pack->data = mmap(NULL, pack->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (pack->data == MAP_FAILED) {
+		pack->data = NULL;
+	}
+	close(fd); // the mapping stays valid
+#endif
+	if (!pack->data || !Validate(pack)) {
+		CloseAssetPack(pack);
+		return NULL;
+	}
+	const char* slash = strrchr(path, '/');
+#ifdef _WIN32
+	const char* backslash = strrchr(path, '\\');
+	if (backslash > slash) {
+		slash = backslash;
+	}
+#endif
+	size_t length = slash ? (size_t)(slash - path + 1) : 0;
+	pack->root = malloc(length + 1);
+	memcpy(pack->root, path, length);
+	pack->root[length] = '\0';
+	return pack;
+}
+
+void CloseAssetPack(struct AssetPack* pack) {
+	if (!pack) {
+		return;
+	}
+#if defined(_WIN32)
+	if (pack->data) {
+		UnmapViewOfFile(pack->data);
+	}
+	if (pack->mapping) {
+		CloseHandle(pack->mapping);
+	}
+	CloseHandle(pack->file);
+#elif defined(ASSET_PACK_MMAP)
+	if (pack->data) {
+		munmap(pack->data, pack->size);
+	}
+#endif
+	free(pack->root);
+	free(pack);
+}
+
+static int CompareEntry(const void* key, const void* entry) {
+	return strcmp(key, ((const struct AssetPackEntry*)entry)->name);
+}
+
+const struct AssetPackEntry* FindAssetPackEntry(const struct AssetPack* pack, const char* path) {
+	size_t length = strlen(pack->root);
+	if (strncmp(path, pack->root, length) != 0) {
+		return NULL;
+	}
+	char name[sizeof(pack->entries->name)];
+	size_t i = 0;
+	for (const char* c = path + length; *c; c++) {
+		if (i == sizeof(name) - 1) {
+			return NULL;
+		}
+		name[i++] = (*c == '\\') ? '/' : *c;
+	}
+	name[i] = '\0';
+	return bsearch(name, pack->entries, pack->header->count, sizeof(struct AssetPackEntry), CompareEntry);
+}
+
+// Mounted pack along with the interfaces that were in use before, which serve
+// everything the pack doesn't have.
+static struct AssetPack* mounted = NULL;
+static const ALLEGRO_FILE_INTERFACE* loose_file = NULL;
+static const ALLEGRO_FS_INTERFACE* loose_fs = NULL;
+static ALLEGRO_FS_INTERFACE pack_fs;
+
+struct PackFile {
+	ALLEGRO_FILE* loose; // set when the file isn't served from the pack
+	const unsigned char* data;
+	int64_t size, pos;
+	bool eof;
+};
+
+static void* PackOpen(const char* path, const char* mode) {
+	bool read_only = !strpbrk(mode, "wa+");
+	const struct AssetPackEntry* entry = read_only ? FindAssetPackEntry(mounted, path) : NULL;
+	struct PackFile* file = calloc(1, sizeof(struct PackFile));
+	if (entry) {
+		file->data = (const unsigned char*)mounted->data + entry->offset;
+		file->size = entry->size;
+		return file;
+	}
+	file->loose = al_fopen_interface(loose_file, path, mode);
+	if (!file->loose) {
+		free(file);
+		return NULL;
+	}
+	return file;
+}
+
+static bool PackClose(ALLEGRO_FILE* handle) {
+	struct PackFile* file = al_get_file_userdata(handle);
+	bool ret = file->loose ? al_fclose(file->loose) : true;
+	free(file);
+	return ret;
+}
+
+static size_t PackRead(ALLEGRO_FILE* handle, void* ptr, size_t size) {
+	struct PackFile* file = al_get_file_userdata(handle);
+	if (file->loose) {
+		return al_fread(file->loose, ptr, size);
+	}
+	size_t left = file->size - file->pos;
+	if (size > left) {
+		size = left;
+		file->eof = true;
+	}
+	memcpy(ptr, file->data + file->pos, size);
+	file->pos += size;
+	return size;
+}
+
+static size_t PackWrite(ALLEGRO_FILE* handle, const void* ptr, size_t size) {
+	struct PackFile* file = al_get_file_userdata(handle);
+	return file->loose ? al_fwrite(file->loose, ptr, size) : 0;
+}
+
+static bool PackFlush(ALLEGRO_FILE* handle) {
+	struct PackFile* file = al_get_file_userdata(handle);
+	return file->loose ? al_fflush(file->loose) : true;
+}
+
+static int64_t PackTell(ALLEGRO_FILE* handle) {
+	struct PackFile* file = al_get_file_userdata(handle);
+	return file->loose ? al_ftell(file->loose) : file->pos;
+}
+
+static bool PackSeek(ALLEGRO_FILE* handle, int64_t offset, int whence) {
+	struct PackFile* file = al_get_file_userdata(handle);
+	if (file->loose) {
+		return al_fseek(file->loose, offset, whence);
+	}
+	if (whence == ALLEGRO_SEEK_CUR) {
+		offset += file->pos;
+	} else if (whence == ALLEGRO_SEEK_END) {
+		offset += file->size;
+	}
+	if ((offset < 0) || (offset > file->size)) {
+		return false;
+	}
+	file->pos = offset;
+	file->eof = false;
+	return true;
+}
+
+static bool PackEOF(ALLEGRO_FILE* handle) {
+	struct PackFile* file = al_get_file_userdata(handle);
+	return file->loose ? al_feof(file->loose) : file->eof;
+}
+
+static int PackError(ALLEGRO_FILE* handle) {
+	struct PackFile* file = al_get_file_userdata(handle);
+	return file->loose ? al_ferror(file->loose) : 0;
+}
+
+static const char* PackErrorMessage(ALLEGRO_FILE* handle) {
+	struct PackFile* file = al_get_file_userdata(handle);
+	return file->loose ? al_ferrmsg(file->loose) : "";
+}
+
+static void PackClearError(ALLEGRO_FILE* handle) {
+	struct PackFile* file = al_get_file_userdata(handle);
+	if (file->loose) {
+		al_fclearerr(file->loose);
+	} else {
+		file->eof = false;
+	}
+}
+
+static int PackUngetc(ALLEGRO_FILE* handle, int c) {
+	struct PackFile* file = al_get_file_userdata(handle);
+	if (file->loose) {
+		return al_fungetc(file->loose, c);
+	}
+	// the data is read-only, so this only works for what was actually read
+	if ((file->pos == 0) || (file->data[file->pos - 1] != (unsigned char)c)) {
+		return EOF;
+	}
+	file->pos--;
+	file->eof = false;
+	return c;
+}
+
+static off_t PackSize(ALLEGRO_FILE* handle) {
+	struct PackFile* file = al_get_file_userdata(handle);
+	return file->loose ? al_fsize(file->loose) : file->size;
+}
+
+static const ALLEGRO_FILE_INTERFACE pack_file = {
+	.fi_fopen = PackOpen,
+	.fi_fclose = PackClose,
+	.fi_fread = PackRead,
+	.fi_fwrite = PackWrite,
+	.fi_fflush = PackFlush,
+	.fi_ftell = PackTell,
+	.fi_fseek = PackSeek,
+	.fi_feof = PackEOF,
+	.fi_ferror = PackError,
+	.fi_ferrmsg = PackErrorMessage,
+	.fi_fclearerr = PackClearError,
+	.fi_fungetc = PackUngetc,
+	.fi_fsize = PackSize,
+};
+
+static bool PackFilenameExists(const char* path) {
+	return FindAssetPackEntry(mounted, path) || loose_fs->fs_filename_exists(path);
+}
+
+void MountAssetPack(struct AssetPack* pack) {
+	if (!pack) {
+		return;
+	}
+	mounted = pack;
+	loose_file = al_get_new_file_interface();
+	loose_fs = al_get_fs_interface();
+	pack_fs = *loose_fs;
+	pack_fs.fs_filename_exists = PackFilenameExists;
+	UseAssetPack();
+}
+
+void UseAssetPack(void) {
+	if (!mounted) {
+		return;
+	}
+	al_set_new_file_interface(&pack_file);
+	al_set_fs_interface(&pack_fs);
+}
+
+void UnmountAssetPack(void) {
+	if (!mounted) {
+		return;
+	}
+	al_set_new_file_interface(loose_file);
+	al_set_fs_interface(loose_fs);
+	mounted = NULL;
+}
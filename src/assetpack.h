@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZENEKGIENEK_ASSETPACK_H
+#define ZENEKGIENEK_ASSETPACK_H
+
+#include "assetpackformat.h"
+#include <allegro5/allegro.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Assets packed ahead of time (by zenekgienek_packbake) into a single file
+// that gets memory-mapped at runtime. While it's mounted, Allegro's file and
+// filesystem functions see the packed files as if they were still loose in
+// the data directory and read them straight out of the mapping; anything not
+// in the pack (or opened for writing) goes to the disk as usual, so without a
+// pack nothing changes at all. The file format is in assetpackformat.h.
+
+struct AssetPack {
+	void* data;
+	size_t size;
+	struct AssetPackHeader* header;
+	struct AssetPackEntry* entries;
+	char* root; // directory the pack is in, with a trailing separator
+#ifdef _WIN32
+	void *file, *mapping;
+#endif
+};
+
+// Returns NULL when there's no usable pack at given path.
+struct AssetPack* OpenAssetPack(const char* path);
+// Must not be called while it's mounted.
+void CloseAssetPack(struct AssetPack* pack);
+// Takes a path to a file in the pack's directory.
+const struct AssetPackEntry* FindAssetPackEntry(const struct AssetPack* pack, const char* path);
+
+// Mounts the pack (NULL does nothing) and uses it on the calling thread.
+void MountAssetPack(struct AssetPack* pack);
+// Allegro's file and filesystem interfaces are set per thread, so every other
+// thread that loads assets has to call this first. Does nothing without a pack.
+void UseAssetPack(void);
+// Goes back to loose files on the calling thread; call before closing the pack.
+void UnmountAssetPack(void);
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZENEKGIENEK_ASSETPACKFORMAT_H
+#define ZENEKGIENEK_ASSETPACKFORMAT_H
+
+#include <stdint.h>
+
+// On-disk layout of asset packs, kept apart from assetpack.h so that the
+// packing tool doesn't need Allegro.
+//
+// Layout: AssetPackHeader, followed by `count` AssetPackEntry records sorted
+// by name; data of every entry starts at a multiple of ASSET_PACK_ALIGNMENT.
+
+#define ASSET_PACK_MAGIC "ZGPAKv1"
+#define ASSET_PACK_VERSION 1
+#define ASSET_PACK_ALIGNMENT 4096
+
+struct AssetPackHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t count;
+};
+
+struct AssetPackEntry {
+	char name[112]; // path relative to the data directory, with '/' separators
+	uint64_t offset, size;
+};
+
+#endif
@@ -0,0 +1,135 @@
+/*! \file atlas.c
+ *  \brief Sprite atlas and batched drawing.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "atlas.h"
+
+#define ATLAS_WIDTH 512
+#define ATLAS_PADDING 1
+
+struct Atlas* CreateAtlas(struct Game* game, struct Character** characters, int count) {
+	struct Atlas* atlas = calloc(1, sizeof(struct Atlas));
+
+	for (int c = 0; c < count; c++) {
+		for (struct Spritesheet* sheet = characters[c]->spritesheets; sheet; sheet = sheet->next) {
+			atlas->sheets = realloc(atlas->sheets, sizeof(struct AtlasSheet) * (atlas->sheets_count + 1));
+			atlas->sheets[atlas->sheets_count++] = (struct AtlasSheet){.spritesheet = sheet, .first = atlas->regions_count};
+			atlas->regions = realloc(atlas->regions, sizeof(struct AtlasRegion) * (atlas->regions_count + sheet->frame_count));
+			atlas->regions_count += sheet->frame_count;
+		}
+	}
+
+	// simple shelf packing; there are just a few dozens of small frames
+	int x = 0, y = 0, shelf = 0;
+	for (int s = 0; s < atlas->sheets_count; s++) {
+		struct Spritesheet* sheet = atlas->sheets[s].spritesheet;
+		for (int i = 0; i < sheet->frame_count; i++) {
+			int w = al_get_bitmap_width(sheet->frames[i].bitmap), h = al_get_bitmap_height(sheet->frames[i].bitmap);
+			if (x + w > ATLAS_WIDTH) {
+				x = 0;
+				y += shelf + ATLAS_PADDING;
+				shelf = 0;
+			}
+			atlas->regions[atlas->sheets[s].first + i] = (struct AtlasRegion){.x = x, .y = y, .w = w, .h = h};
+			x += w + ATLAS_PADDING;
+			if (h > shelf) {
+				shelf = h;
+			}
+		}
+	}
+
+	atlas->bitmap = al_create_bitmap(ATLAS_WIDTH, y + shelf);
+	if (!atlas->bitmap) {
+		PrintConsole(game, "Couldn't create sprite atlas!");
+		return atlas;
+	}
+	ALLEGRO_BITMAP* target = al_get_target_bitmap();
+	al_set_target_bitmap(atlas->bitmap);
+	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+	for (int s = 0; s < atlas->sheets_count; s++) {
+		struct Spritesheet* sheet = atlas->sheets[s].spritesheet;
+		for (int i = 0; i < sheet->frame_count; i++) {
+			struct AtlasRegion* region = &atlas->regions[atlas->sheets[s].first + i];
+			al_draw_bitmap(sheet->frames[i].bitmap, region->x, region->y, 0);
+		}
+	}
+	al_set_target_bitmap(target);
+	return atlas;
+}
+
+void DestroyAtlas(struct Atlas* atlas) {
+	if (atlas->bitmap) {
+		al_destroy_bitmap(atlas->bitmap);
+	}
+	free(atlas->regions);
+	free(atlas->sheets);
+	free(atlas);
+}
+
+bool GetAtlasRegion(struct Atlas* atlas, struct Character* character, struct AtlasRegion* region) {
+	if (!atlas->bitmap || !character->spritesheet || !character->frame) {
+		return false;
+	}
+	for (int s = 0; s < atlas->sheets_count; s++) {
+		if (atlas->sheets[s].spritesheet == character->spritesheet) {
+			*region = atlas->regions[atlas->sheets[s].first + (character->frame - character->spritesheet->frames)];
+			return true;
+		}
+	}
+	return false;
+}
+
+void BatchQuad(struct VertexBatch* batch, float x1, float y1, float x2, float y2, float u1, float v1, float u2, float v2, ALLEGRO_COLOR color) {
+	if (batch->count + 6 > batch->capacity) {
+		int capacity = batch->capacity ? batch->capacity * 2 : 6 * 256;
+		ALLEGRO_VERTEX* vertices = realloc(batch->vertices, sizeof(ALLEGRO_VERTEX) * capacity);
+		if (!vertices) {
+			return;
+		}
+		batch->vertices = vertices;
+		batch->capacity = capacity;
+	}
+	ALLEGRO_VERTEX* v = &batch->vertices[batch->count];
+	v[0] = (ALLEGRO_VERTEX){.x = x1, .y = y1, .u = u1, .v = v1, .color = color};
+	v[1] = (ALLEGRO_VERTEX){.x = x1, .y = y2, .u = u1, .v = v2, .color = color};
+	v[2] = (ALLEGRO_VERTEX){.x = x2, .y = y2, .u = u2, .v = v2, .color = color};
+	v[3] = v[0];
+	v[4] = (ALLEGRO_VERTEX){.x = x2, .y = y1, .u = u2, .v = v1, .color = color};
+	v[5] = v[2];
+	batch->count += 6;
+}
+
+void BatchRegion(struct VertexBatch* batch, struct AtlasRegion* region, float x, float y) {
+	// same placement as DrawCentered
+	x -= (int)region->w / 2;
+	y -= (int)region->h / 2;
+	BatchQuad(batch, x, y, x + region->w, y + region->h, region->x, region->y, region->x + region->w, region->y + region->h, al_map_rgb(255, 255, 255));
+}
+
+void FlushBatch(struct VertexBatch* batch, ALLEGRO_BITMAP* texture) {
+	if (batch->count) {
+		al_draw_prim(batch->vertices, NULL, texture, 0, batch->count, ALLEGRO_PRIM_TRIANGLE_LIST);
+	}
+	batch->count = 0;
+}
+
+void DestroyBatch(struct VertexBatch* batch) {
+	free(batch->vertices);
+	*batch = (struct VertexBatch){0};
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZENEKGIENEK_ATLAS_H
+#define ZENEKGIENEK_ATLAS_H
+
+#include <libsuperderpy.h>
+
+// All frames of a set of characters packed into a single bitmap, so that
+// whatever they show at the moment can be drawn in one al_draw_prim call.
+
+struct AtlasRegion {
+	float x, y, w, h;
+};
+
+struct AtlasSheet {
+	struct Spritesheet* spritesheet;
+	int first; // index of its first frame in regions
+};
+
+struct Atlas {
+	ALLEGRO_BITMAP* bitmap;
+	struct AtlasRegion* regions;
+	int regions_count;
+	struct AtlasSheet* sheets;
+	int sheets_count;
+};
+
+// Growable list of triangles submitted together.
+struct VertexBatch {
+	ALLEGRO_VERTEX* vertices;
+	int count, capacity;
+};
+
+struct Atlas* CreateAtlas(struct Game* game, struct Character** characters, int count);
+void DestroyAtlas(struct Atlas* atlas);
+// Finds where the current frame of given character is. Returns false when the
+// character shows a spritesheet that hasn't been packed.
+bool GetAtlasRegion(struct Atlas* atlas, struct Character* character, struct AtlasRegion* region);
+
+void BatchQuad(struct VertexBatch* batch, float x1, float y1, float x2, float y2, float u1, float v1, float u2, float v2, ALLEGRO_COLOR color);
+void BatchRegion(struct VertexBatch* batch, struct AtlasRegion* region, float x, float y);
+void FlushBatch(struct VertexBatch* batch, ALLEGRO_BITMAP* texture);
+void DestroyBatch(struct VertexBatch* batch);
+
+#endif
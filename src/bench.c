@@ -0,0 +1,536 @@
+/*! \file bench.c
+ *  \brief Micro-benchmarks of gameplay hot paths.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// A small harness mimicking Google Benchmark: every benchmark is run with
+// a number of iterations grown until it takes at least --benchmark_min_time,
+// and the results can be written out in the same JSON format, so the usual
+// tooling (e.g. compare.py) can be used to track them across commits.
+//
+//   zenekgienek_bench [--benchmark_filter=REGEX] [--benchmark_min_time=SECONDS]
+//                     [--benchmark_format=console|json]
+//                     [--benchmark_out=FILE] [--benchmark_out_format=console|json]
+
+#include "movement.h"
+#include "projection.h"
+#include "sim.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <regex.h>
+#endif
+
+struct BenchmarkState {
+	int64_t range;
+	int64_t iterations, done;
+	int64_t items; // processed items in total, for items_per_second
+	double real_start, cpu_start;
+	double real_time, cpu_time;
+	bool paused;
+	const char* error;
+};
+
+typedef void BenchmarkFunction(struct BenchmarkState*);
+
+static double Now(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void PauseTiming(struct BenchmarkState* state) {
+	if (!state->paused) {
+		state->real_time += Now(CLOCK_MONOTONIC) - state->real_start;
+		state->cpu_time += Now(CLOCK_PROCESS_CPUTIME_ID) - state->cpu_start;
+		state->paused = true;
+	}
+}
+
+static void ResumeTiming(struct BenchmarkState* state) {
+	if (state->paused) {
+		state->real_start = Now(CLOCK_MONOTONIC);
+		state->cpu_start = Now(CLOCK_PROCESS_CPUTIME_ID);
+		state->paused = false;
+	}
+}
+
+// Used as `while (KeepRunning(state)) { ... }`; everything before the first
+// call is setup and isn't measured.
+static bool KeepRunning(struct BenchmarkState* state) {
+	if (state->error) {
+		return false;
+	}
+	if (state->done == 0) {
+		ResumeTiming(state);
+	}
+	if (state->done == state->iterations) {
+		PauseTiming(state);
+		return false;
+	}
+	state->done++;
+	return true;
+}
+
+static void SkipWithError(struct BenchmarkState* state, const char* error) {
+	state->error = error;
+}
+
+static volatile double sink;
+
+// Fills a sim with count wandering entities spread all over the world, with
+// one in eight of them being a bullet flying around the player.
+static struct Sim* CreatePopulatedSim(int64_t count) {
+	struct Sim* sim = CreateSim(42);
+	uint64_t rng = 42;
+	for (int64_t i = 0; i < count; i++) {
+		rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+		double a = (rng >> 11) * (1.0 / 9007199254740992.0);
+		rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+		double b = (rng >> 11) * (1.0 / 9007199254740992.0);
+		if (i % 8 == 0) {
+			SimSpawn(sim, sim->x + (a - 0.5) * 640, sim->y + (b - 0.5) * 640, a * 2 * M_PI, TYPE_BULLET);
+		} else {
+			static const enum ENTITY_TYPE types[] = {TYPE_USER, TYPE_USER, TYPE_USER, TYPE_MESSAGE, TYPE_FAKE, TYPE_ENEMY, TYPE_USER};
+			SimSpawn(sim, a * SIM_WORLD_SIZE, b * SIM_WORLD_SIZE, b * 2 * M_PI, types[i % 8 - 1]);
+		}
+	}
+	return sim;
+}
+
+static void BM_SpawnEntity(struct BenchmarkState* state) {
+	while (KeepRunning(state)) {
+		PauseTiming(state);
+		struct Sim* sim = CreateSim(42);
+		ResumeTiming(state);
+		for (int64_t i = 0; i < state->range; i++) {
+			SimSpawn(sim, i % SIM_WORLD_SIZE, i / SIM_WORLD_SIZE, 0, TYPE_USER);
+		}
+		PauseTiming(state);
+		DestroySim(sim);
+		ResumeTiming(state);
+	}
+	state->items = state->iterations * state->range;
+}
+
+static void BM_SimCollide(struct BenchmarkState* state) {
+	// collisions remove and convert entities, so every iteration gets a fresh world
+	while (KeepRunning(state)) {
+		PauseTiming(state);
+		struct Sim* sim = CreatePopulatedSim(state->range);
+		ResumeTiming(state);
+		SimCollide(sim);
+		PauseTiming(state);
+		DestroySim(sim);
+		ResumeTiming(state);
+	}
+	state->items = state->iterations * state->range;
+}
+
+static void BM_SimMove(struct BenchmarkState* state) {
+	struct Sim* sim = CreatePopulatedSim(state->range);
+	while (KeepRunning(state)) {
+		SimMoveBullets(sim);
+		SimMoveWanderers(sim);
+	}
+	sink = sim->entities->lists[TYPE_USER].x[0];
+	DestroySim(sim);
+	state->items = state->iterations * state->range;
+}
+
+// Same as BM_SimMove, but split into chunks run on a job thread per extra core.
+static void BM_SimMoveJobs(struct BenchmarkState* state) {
+	struct JobPool* jobs = CreateJobPool(sysconf(_SC_NPROCESSORS_ONLN) - 1);
+	struct Sim* sim = CreatePopulatedSim(state->range);
+	SetSimJobs(sim, jobs);
+	while (KeepRunning(state)) {
+		SimMoveBullets(sim);
+		SimMoveWanderers(sim);
+	}
+	sink = sim->entities->lists[TYPE_USER].x[0];
+	DestroySim(sim);
+	DestroyJobPool(jobs);
+	state->items = state->iterations * state->range;
+}
+
+// What Gamestate_Logic used to do for every bullet.
+static void MoveEntitiesReference(double* x, double* y, double* distance, const double* angle, double step, int count) {
+	for (int i = 0; i < count; i++) {
+		x[i] += sin(angle[i]) * step;
+		y[i] += cos(angle[i]) * step;
+		distance[i] += sqrt(pow(sin(angle[i]) * step, 2) + pow(cos(angle[i]) * step, 2));
+	}
+}
+
+struct MovementData {
+	double *x, *y, *distance, *angle, *dx, *dy;
+};
+
+static struct MovementData CreateMovementData(int count) {
+	struct MovementData data = {
+		calloc(count, sizeof(double)), calloc(count, sizeof(double)), calloc(count, sizeof(double)),
+		malloc(sizeof(double) * count), malloc(sizeof(double) * count), malloc(sizeof(double) * count)};
+	for (int i = 0; i < count; i++) {
+		data.angle[i] = i * 0.618;
+		data.dx[i] = sin(data.angle[i]);
+		data.dy[i] = cos(data.angle[i]);
+	}
+	return data;
+}
+
+static void DestroyMovementData(struct MovementData* data) {
+	sink = data->x[0] + data->y[0] + data->distance[0];
+	free(data->x);
+	free(data->y);
+	free(data->distance);
+	free(data->angle);
+	free(data->dx);
+	free(data->dy);
+}
+
+static void BM_MoveEntitiesReference(struct BenchmarkState* state) {
+	struct MovementData data = CreateMovementData(state->range);
+	while (KeepRunning(state)) {
+		MoveEntitiesReference(data.x, data.y, data.distance, data.angle, 5, state->range);
+	}
+	DestroyMovementData(&data);
+	state->items = state->iterations * state->range;
+}
+
+static void BM_MoveEntitiesScalar(struct BenchmarkState* state) {
+	struct MovementData data = CreateMovementData(state->range);
+	while (KeepRunning(state)) {
+		MoveEntitiesScalar(data.x, data.y, data.distance, data.dx, data.dy, 5, state->range);
+	}
+	DestroyMovementData(&data);
+	state->items = state->iterations * state->range;
+}
+
+static void BM_MoveEntities(struct BenchmarkState* state) {
+	struct MovementData data = CreateMovementData(state->range), ref = CreateMovementData(state->range);
+
+	// the batched kernel has to stay in line with what the game used to compute
+	MoveEntities(data.x, data.y, data.distance, data.dx, data.dy, 5, state->range);
+	MoveEntitiesReference(ref.x, ref.y, ref.distance, ref.angle, 5, state->range);
+	for (int64_t i = 0; i < state->range; i++) {
+		if ((fabs(data.x[i] - ref.x[i]) > 1e-6) || (fabs(data.y[i] - ref.y[i]) > 1e-6) || (fabs(data.distance[i] - ref.distance[i]) > 1e-6)) {
+			SkipWithError(state, "movement kernel doesn't match the reference implementation");
+			break;
+		}
+	}
+
+	while (KeepRunning(state)) {
+		MoveEntities(data.x, data.y, data.distance, data.dx, data.dy, 5, state->range);
+	}
+	DestroyMovementData(&data);
+	DestroyMovementData(&ref);
+	state->items = state->iterations * state->range;
+}
+
+// projview of the main gamestate, player standing in the middle of the world
+static const float projview[4][4] = {
+	{-0.025f, 0.0f, 0.0f, 0.0f},
+	{0.0f, -0.0444f, -0.005f, -0.005f},
+	{0.0f, 0.0f, -1.0f, -1.0f},
+	{102.4f, 273.07f, 32.5f, 32.5f},
+};
+
+static void BM_TransformCoordinates3DProjective(struct BenchmarkState* state) {
+	float* xs = malloc(sizeof(float) * state->range);
+	float* ys = malloc(sizeof(float) * state->range);
+	for (int64_t i = 0; i < state->range; i++) {
+		xs[i] = (i * 7919) % SIM_WORLD_SIZE;
+		ys[i] = (i * 104729) % SIM_WORLD_SIZE;
+	}
+	while (KeepRunning(state)) {
+		float acc = 0;
+		for (int64_t i = 0; i < state->range; i++) {
+			float x = xs[i], y = ys[i], z = 0;
+			TransformCoordinates3DProjective(projview, &x, &y, &z);
+			acc += x + y + z;
+		}
+		sink = acc;
+	}
+	free(xs);
+	free(ys);
+	state->items = state->iterations * state->range;
+}
+
+static void BM_ProjectGroundPoints(struct BenchmarkState* state) {
+	struct Sim* sim = CreatePopulatedSim(state->range);
+	struct EntityList* list = &sim->entities->lists[TYPE_USER];
+	float* sx = malloc(sizeof(float) * list->count);
+	float* sy = malloc(sizeof(float) * list->count);
+	float* sz = malloc(sizeof(float) * list->count);
+	int* visible = malloc(sizeof(int) * list->count);
+
+	ProjectGroundPoints(projview, list->x, list->y, list->count, 320, 180, 16, sx, sy, sz, visible);
+	for (int i = 0; i < list->count; i++) {
+		float x = list->x[i], y = list->y[i], z = 0;
+		TransformCoordinates3DProjective(projview, &x, &y, &z);
+		x = x * 320 / 2 + 320 / 2;
+		y = y * -180 / 2 + 180 / 2;
+		if ((fabsf(x - sx[i]) > 1e-3f * fmaxf(1, fabsf(x))) || (fabsf(y - sy[i]) > 1e-3f * fmaxf(1, fabsf(y))) || (fabsf(z - sz[i]) > 1e-3f * fmaxf(1, fabsf(z)))) {
+			SkipWithError(state, "batch projection doesn't match TransformCoordinates3DProjective");
+			break;
+		}
+	}
+
+	int visible_count = 0;
+	while (KeepRunning(state)) {
+		visible_count = ProjectGroundPoints(projview, list->x, list->y, list->count, 320, 180, 16, sx, sy, sz, visible);
+	}
+	sink = visible_count;
+	state->items = state->iterations * list->count;
+
+	free(sx);
+	free(sy);
+	free(sz);
+	free(visible);
+	DestroySim(sim);
+}
+
+static const struct {
+	const char* name;
+	BenchmarkFunction* func;
+} benchmarks[] = {
+	{"BM_SpawnEntity", BM_SpawnEntity},
+	{"BM_SimCollide", BM_SimCollide},
+	{"BM_SimMove", BM_SimMove},
+	{"BM_SimMoveJobs", BM_SimMoveJobs},
+	{"BM_MoveEntitiesReference", BM_MoveEntitiesReference},
+	{"BM_MoveEntitiesScalar", BM_MoveEntitiesScalar},
+	{"BM_MoveEntities", BM_MoveEntities},
+	{"BM_TransformCoordinates3DProjective", BM_TransformCoordinates3DProjective},
+	{"BM_ProjectGroundPoints", BM_ProjectGroundPoints},
+};
+
+// entity counts; the game itself rarely goes past a few thousands
+static const int64_t ranges[] = {64, 512, 4096, 8192, 32768, 131072};
+
+struct Result {
+	char name[96];
+	int64_t iterations;
+	double real_time, cpu_time; // per iteration, in nanoseconds
+	double items_per_second;
+	const char* error;
+};
+
+static struct Result Run(const char* name, BenchmarkFunction* func, int64_t range, double min_time) {
+	struct Result result = {0};
+	snprintf(result.name, sizeof(result.name), "%s/%lld", name, (long long)range);
+
+	int64_t iterations = 1;
+	struct BenchmarkState state;
+	while (true) {
+		state = (struct BenchmarkState){.range = range, .iterations = iterations, .paused = true};
+		func(&state);
+		if (state.error || (state.real_time >= min_time) || (iterations >= 1000000000)) {
+			break;
+		}
+		// same growth rule as Google Benchmark: aim a bit past min_time, but at most 10x at once
+		double multiplier = state.real_time > 0 ? min_time * 1.4 / state.real_time : 10;
+		multiplier = fmin(fmax(multiplier, 1.0), 10.0);
+		int64_t next = (int64_t)(iterations * multiplier);
+		iterations = next > iterations ? next : iterations + 1;
+	}
+
+	result.iterations = state.iterations;
+	result.real_time = state.real_time / state.iterations * 1e9;
+	result.cpu_time = state.cpu_time / state.iterations * 1e9;
+	result.items_per_second = state.cpu_time > 0 ? state.items / state.cpu_time : 0;
+	result.error = state.error;
+	return result;
+}
+
+static void PrintConsoleHeader(FILE* out) {
+	fprintf(out, "movement kernel: %s\n", GetMovementKernelName());
+	fprintf(out, "%-48s %13s %13s %12s %s\n", "Benchmark", "Time", "CPU", "Iterations", "UserCounters...");
+	fprintf(out, "--------------------------------------------------------------------------------------------------------\n");
+}
+
+static void PrintConsoleResult(FILE* out, struct Result* result) {
+	if (result->error) {
+		fprintf(out, "%-48s ERROR OCCURRED: '%s'\n", result->name, result->error);
+		return;
+	}
+	fprintf(out, "%-48s %10.0f ns %10.0f ns %12lld items_per_second=%.5gM/s\n", result->name,
+		result->real_time, result->cpu_time, (long long)result->iterations, result->items_per_second / 1e6);
+}
+
+static void PrintJSONHeader(FILE* out, const char* executable) {
+	char date[64];
+	time_t now = time(NULL);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+	fprintf(out, "{\n");
+	fprintf(out, "  \"context\": {\n");
+	fprintf(out, "    \"date\": \"%s\",\n", date);
+	fprintf(out, "    \"executable\": \"%s\",\n", executable);
+	fprintf(out, "    \"movement_kernel\": \"%s\",\n", GetMovementKernelName());
+#ifdef NDEBUG
+	fprintf(out, "    \"library_build_type\": \"release\"\n");
+#else
+	fprintf(out, "    \"library_build_type\": \"debug\"\n");
+#endif
+	fprintf(out, "  },\n");
+	fprintf(out, "  \"benchmarks\": [");
+}
+
+static void PrintJSONResult(FILE* out, struct Result* result, bool first) {
+	fprintf(out, "%s\n    {\n", first ? "" : ",");
+	fprintf(out, "      \"name\": \"%s\",\n", result->name);
+	fprintf(out, "      \"run_name\": \"%s\",\n", result->name);
+	fprintf(out, "      \"run_type\": \"iteration\",\n");
+	fprintf(out, "      \"repetitions\": 1,\n");
+	if (result->error) {
+		fprintf(out, "      \"error_occurred\": true,\n");
+		fprintf(out, "      \"error_message\": \"%s\"\n", result->error);
+	} else {
+		fprintf(out, "      \"iterations\": %lld,\n", (long long)result->iterations);
+		fprintf(out, "      \"real_time\": %.6e,\n", result->real_time);
+		fprintf(out, "      \"cpu_time\": %.6e,\n", result->cpu_time);
+		fprintf(out, "      \"time_unit\": \"ns\",\n");
+		fprintf(out, "      \"items_per_second\": %.6e\n", result->items_per_second);
+	}
+	fprintf(out, "    }");
+}
+
+static void PrintJSONFooter(FILE* out) {
+	fprintf(out, "\n  ]\n}\n");
+}
+
+static const char* GetOption(const char* arg, const char* name) {
+	size_t len = strlen(name);
+	if ((strncmp(arg, name, len) == 0) && (arg[len] == '=')) {
+		return arg + len + 1;
+	}
+	return NULL;
+}
+
+int main(int argc, char** argv) {
+	const char *filter = NULL, *format = "console", *out_name = NULL, *out_format = "json", *value;
+	double min_time = 0.5;
+
+	for (int i = 1; i < argc; i++) {
+		if ((value = GetOption(argv[i], "--benchmark_filter"))) {
+			filter = value;
+		} else if ((value = GetOption(argv[i], "--benchmark_min_time"))) {
+			min_time = atof(value);
+		} else if ((value = GetOption(argv[i], "--benchmark_format"))) {
+			format = value;
+		} else if ((value = GetOption(argv[i], "--benchmark_out"))) {
+			out_name = value;
+		} else if ((value = GetOption(argv[i], "--benchmark_out_format"))) {
+			out_format = value;
+		} else {
+			fprintf(stderr, "Usage: %s [--benchmark_filter=REGEX] [--benchmark_min_time=SECONDS]\n", argv[0]);
+			fprintf(stderr, "       [--benchmark_format=console|json] [--benchmark_out=FILE] [--benchmark_out_format=console|json]\n");
+			return 1;
+		}
+	}
+
+#ifndef _WIN32
+	regex_t regex;
+	if (filter && regcomp(&regex, filter, REG_EXTENDED | REG_NOSUB)) {
+		fprintf(stderr, "Invalid filter: %s\n", filter);
+		return 1;
+	}
+#endif
+
+	FILE* out = NULL;
+	if (out_name) {
+		out = fopen(out_name, "w");
+		if (!out) {
+			perror(out_name);
+			return 1;
+		}
+	}
+
+	bool json = strcmp(format, "json") == 0, out_json = strcmp(out_format, "json") == 0;
+	if (json) {
+		PrintJSONHeader(stdout, argv[0]);
+	} else {
+		PrintConsoleHeader(stdout);
+	}
+	if (out) {
+		if (out_json) {
+			PrintJSONHeader(out, argv[0]);
+		} else {
+			PrintConsoleHeader(out);
+		}
+	}
+
+	bool first = true;
+	int errors = 0;
+	for (size_t b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); b++) {
+		for (size_t r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++) {
+			char name[96];
+			snprintf(name, sizeof(name), "%s/%lld", benchmarks[b].name, (long long)ranges[r]);
+#ifndef _WIN32
+			if (filter && regexec(&regex, name, 0, NULL, 0)) {
+				continue;
+			}
+#else
+			if (filter && !strstr(name, filter)) {
+				continue;
+			}
+#endif
+			struct Result result = Run(benchmarks[b].name, benchmarks[b].func, ranges[r], min_time);
+			if (result.error) {
+				errors++;
+			}
+			if (json) {
+				PrintJSONResult(stdout, &result, first);
+			} else {
+				PrintConsoleResult(stdout, &result);
+			}
+			if (out) {
+				if (out_json) {
+					PrintJSONResult(out, &result, first);
+				} else {
+					PrintConsoleResult(out, &result);
+				}
+			}
+			fflush(stdout);
+			first = false;
+		}
+	}
+
+	if (json) {
+		PrintJSONFooter(stdout);
+	}
+	if (out) {
+		if (out_json) {
+			PrintJSONFooter(out);
+		}
+		fclose(out);
+	}
+#ifndef _WIN32
+	if (filter) {
+		regfree(&regex);
+	}
+#endif
+	return errors ? 1 : 0;
+}
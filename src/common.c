@@ -20,6 +20,29 @@
 
 #include "common.h"
 #include <libsuperderpy.h>
+#include <time.h>
+
+static void ToggleTrace(struct Game* game) {
+	struct Profiler* prof = game->data->profiler;
+	if (prof->trace) {
+		StopProfilerTrace(prof);
+		PrintConsole(game, "Profiler trace stopped.");
+		return;
+	}
+
+	char filename[64];
+	time_t now = time(NULL);
+	strftime(filename, sizeof(filename), "trace-%Y%m%d-%H%M%S.json", localtime(&now));
+	ALLEGRO_PATH* path = al_get_standard_path(ALLEGRO_USER_DATA_PATH);
+	al_make_directory(al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP));
+	al_set_path_filename(path, filename);
+	if (StartProfilerTrace(prof, al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP))) {
+		PrintConsole(game, "Writing profiler trace to %s", al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP));
+	} else {
+		PrintConsole(game, "Could not open %s for writing!", al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP));
+	}
+	al_destroy_path(path);
+}
 
 bool GlobalEventHandler(struct Game* game, ALLEGRO_EVENT* ev) {
 	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_F)) {
@@ -28,15 +51,127 @@ bool GlobalEventHandler(struct Game* game, ALLEGRO_EVENT* ev) {
 	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_M)) {
 		ToggleMute(game);
 	}
+	if (game->data && (ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_F3)) {
+		game->data->profiler->overlay = !game->data->profiler->overlay;
+	}
+	if (game->data && (ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_F4)) {
+		ToggleTrace(game);
+	}
 
 	return false;
 }
 
 struct CommonResources* CreateGameData(struct Game* game) {
 	struct CommonResources* data = calloc(1, sizeof(struct CommonResources));
+	data->profiler = CreateProfiler();
 	return data;
 }
 
 void DestroyGameData(struct Game* game) {
+	HideSubtitle(game);
+	DestroyProfiler(game->data->profiler);
 	free(game->data);
 }
+
+// Ends the profiler frame and draws its overlay over the whole window, at the
+// window's own resolution rather than the game's 320x180.
+void GlobalPostDraw(struct Game* game) {
+	if (!game->data) {
+		return;
+	}
+	struct Profiler* prof = game->data->profiler;
+	ProfilerFrame(prof);
+	if (!prof->overlay) {
+		return;
+	}
+
+	ALLEGRO_TRANSFORM transform, projection, identity, ortho;
+	al_set_target_backbuffer(game->display);
+	al_copy_transform(&transform, al_get_current_transform());
+	al_copy_transform(&projection, al_get_current_projection_transform());
+	al_identity_transform(&identity);
+	al_identity_transform(&ortho);
+	al_orthographic_transform(&ortho, 0, 0, -1, al_get_display_width(game->display), al_get_display_height(game->display), 1);
+	al_use_transform(&identity);
+	al_use_projection_transform(&ortho);
+	al_reset_clipping_rectangle();
+
+	DrawProfiler(prof);
+
+	al_use_projection_transform(&projection);
+	al_use_transform(&transform);
+}
+
+#define SUBTITLE_WIDTH 320
+#define SUBTITLE_HEIGHT 53
+#define SUBTITLE_MARGIN 3
+
+static bool AddSubtitleLine(int line, const char* text, int size, void* extra) {
+	struct CommonResources* data = extra;
+	char** lines = realloc(data->subtitle.lines, sizeof(char*) * (data->subtitle.lines_count + 1));
+	if (!lines) {
+		return false;
+	}
+	data->subtitle.lines = lines;
+	// not null-terminated, and strndup isn't there on Windows
+	char* copy = malloc(size + 1);
+	memcpy(copy, text, size);
+	copy[size] = '\0';
+	data->subtitle.lines[data->subtitle.lines_count++] = copy;
+	return true;
+}
+
+static void DrawSubtitleBox(struct Game* game) {
+	ALLEGRO_FONT* font = game->data->subtitle.font;
+	int height = al_get_font_line_height(font);
+	al_draw_filled_rectangle(0, 0, SUBTITLE_WIDTH, SUBTITLE_HEIGHT, al_map_rgba(0, 0, 0, 128));
+	al_draw_text(font, al_map_rgb(255, 255, 255), SUBTITLE_MARGIN, SUBTITLE_MARGIN, ALLEGRO_ALIGN_LEFT, game->data->person);
+	for (int i = 0; i < game->data->subtitle.lines_count; i++) {
+		al_draw_text(font, al_map_rgb(255, 255, 255), SUBTITLE_MARGIN, SUBTITLE_MARGIN + 10 + i * height, ALLEGRO_ALIGN_LEFT, game->data->subtitle.lines[i]);
+	}
+}
+
+void ShowSubtitle(struct Game* game, ALLEGRO_FONT* font, char* person, char* text) {
+	HideSubtitle(game);
+	game->data->text = text;
+	game->data->person = person;
+	game->data->subtitle.font = font;
+	al_do_multiline_text(font, SUBTITLE_WIDTH - 2 * SUBTITLE_MARGIN, text, AddSubtitleLine, game->data);
+
+	game->data->subtitle.bitmap = al_create_bitmap(SUBTITLE_WIDTH, SUBTITLE_HEIGHT);
+	if (!game->data->subtitle.bitmap) {
+		return; // DrawSubtitle will draw the cached lines directly
+	}
+	ALLEGRO_BITMAP* target = al_get_target_bitmap();
+	al_set_target_bitmap(game->data->subtitle.bitmap);
+	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+	DrawSubtitleBox(game);
+	al_set_target_bitmap(target);
+}
+
+void HideSubtitle(struct Game* game) {
+	for (int i = 0; i < game->data->subtitle.lines_count; i++) {
+		free(game->data->subtitle.lines[i]);
+	}
+	free(game->data->subtitle.lines);
+	if (game->data->subtitle.bitmap) {
+		al_destroy_bitmap(game->data->subtitle.bitmap);
+	}
+	game->data->subtitle.lines = NULL;
+	game->data->subtitle.lines_count = 0;
+	game->data->subtitle.bitmap = NULL;
+	game->data->subtitle.font = NULL;
+	game->data->text = NULL;
+	game->data->person = NULL;
+}
+
+void DrawSubtitle(struct Game* game) {
+	if (!game->data->text) {
+		return;
+	}
+	if (game->data->subtitle.bitmap) {
+		al_draw_bitmap(game->data->subtitle.bitmap, 0, 0, 0);
+	} else {
+		DrawSubtitleBox(game);
+	}
+}
@@ -16,6 +16,7 @@
  */
 
 #define LIBSUPERDERPY_DATA_TYPE struct CommonResources
+#include "profiler.h"
 #include <libsuperderpy.h>
 
 struct CommonResources {
@@ -23,9 +24,22 @@ struct CommonResources {
 	char* text;
 	char* person;
 	bool skip;
+	struct {
+		char** lines; // text wrapped once when the subtitle is shown
+		int lines_count;
+		ALLEGRO_FONT* font;
+		ALLEGRO_BITMAP* bitmap; // whole subtitle box, drawn with a single blit
+	} subtitle;
+	struct Profiler* profiler; // F3 toggles the overlay, F4 starts and stops a trace
 	//ALLEGRO_AUDIO_STREAM* stream;
 };
 
 struct CommonResources* CreateGameData(struct Game* game);
 void DestroyGameData(struct Game* game);
 bool GlobalEventHandler(struct Game* game, ALLEGRO_EVENT* ev);
+void GlobalPostDraw(struct Game* game);
+
+// Sets text and person and lays the subtitle out; the font has to outlive it.
+void ShowSubtitle(struct Game* game, ALLEGRO_FONT* font, char* person, char* text);
+void HideSubtitle(struct Game* game);
+void DrawSubtitle(struct Game* game);
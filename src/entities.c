@@ -0,0 +1,184 @@
+/*! \file entities.c
+ *  \brief Structure-of-arrays storage of live gameplay entities.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "entities.h"
+#include <math.h>
+#include <stdlib.h>
+
+static bool Reserve(void** ptr, size_t size) {
+	void* p = realloc(*ptr, size);
+	if (!p) {
+		return false;
+	}
+	*ptr = p;
+	return true;
+}
+
+static bool ReserveList(struct EntityList* list, int capacity) {
+	if (!Reserve((void**)&list->x, sizeof(double) * capacity) ||
+		!Reserve((void**)&list->y, sizeof(double) * capacity) ||
+		!Reserve((void**)&list->angle, sizeof(double) * capacity) ||
+		!Reserve((void**)&list->distance, sizeof(double) * capacity) ||
+		!Reserve((void**)&list->dx, sizeof(double) * capacity) ||
+		!Reserve((void**)&list->dy, sizeof(double) * capacity) ||
+		!Reserve((void**)&list->score, sizeof(int) * capacity) ||
+		!Reserve((void**)&list->id, sizeof(int) * capacity)) {
+		return false;
+	}
+	list->capacity = capacity;
+	return true;
+}
+
+static bool ReserveIds(struct EntityPool* pool, int capacity) {
+	if (!Reserve((void**)&pool->refs, sizeof(struct EntityRef) * capacity) ||
+		!Reserve((void**)&pool->free_ids, sizeof(int) * capacity)) {
+		return false;
+	}
+	// pushed in reverse, so lower ids get handed out first
+	for (int id = capacity - 1; id >= pool->id_capacity; id--) {
+		pool->free_ids[pool->free_count++] = id;
+	}
+	pool->id_capacity = capacity;
+	return true;
+}
+
+struct EntityPool* CreateEntityPool(int capacity) {
+	struct EntityPool* pool = calloc(1, sizeof(struct EntityPool));
+	if (capacity < 1) {
+		capacity = 1;
+	}
+	for (int i = 0; i < TYPE_COUNT; i++) {
+		ReserveList(&pool->lists[i], capacity);
+	}
+	ReserveIds(pool, capacity);
+	return pool;
+}
+
+void DestroyEntityPool(struct EntityPool* pool) {
+	for (int i = 0; i < TYPE_COUNT; i++) {
+		struct EntityList* list = &pool->lists[i];
+		free(list->x);
+		free(list->y);
+		free(list->angle);
+		free(list->distance);
+		free(list->dx);
+		free(list->dy);
+		free(list->score);
+		free(list->id);
+	}
+	free(pool->refs);
+	free(pool->free_ids);
+	free(pool);
+}
+
+static int Append(struct EntityPool* pool, enum ENTITY_TYPE type, int id) {
+	struct EntityList* list = &pool->lists[type];
+	if (list->count == list->capacity && !ReserveList(list, list->capacity * 2)) {
+		return -1;
+	}
+	int i = list->count++;
+	list->id[i] = id;
+	pool->refs[id].type = type;
+	pool->refs[id].index = i;
+	return i;
+}
+
+int AddEntity(struct EntityPool* pool, enum ENTITY_TYPE type, double x, double y, double angle) {
+	if (!pool->free_count && !ReserveIds(pool, pool->id_capacity * 2)) {
+		return -1;
+	}
+	int id = pool->free_ids[pool->free_count - 1];
+	int i = Append(pool, type, id);
+	if (i < 0) {
+		return -1;
+	}
+	pool->free_count--;
+	pool->count++;
+
+	struct EntityList* list = &pool->lists[type];
+	list->x[i] = x;
+	list->y[i] = y;
+	SetEntityAngle(list, i, angle);
+	list->distance[i] = 0;
+	list->score[i] = 0;
+	return id;
+}
+
+static void Unlink(struct EntityPool* pool, enum ENTITY_TYPE type, int i) {
+	struct EntityList* list = &pool->lists[type];
+	int last = --list->count;
+	if (i != last) {
+		list->x[i] = list->x[last];
+		list->y[i] = list->y[last];
+		list->angle[i] = list->angle[last];
+		list->distance[i] = list->distance[last];
+		list->dx[i] = list->dx[last];
+		list->dy[i] = list->dy[last];
+		list->score[i] = list->score[last];
+		list->id[i] = list->id[last];
+		pool->refs[list->id[i]].index = i;
+	}
+}
+
+void RemoveEntity(struct EntityPool* pool, enum ENTITY_TYPE type, int i) {
+	pool->free_ids[pool->free_count++] = pool->lists[type].id[i];
+	pool->count--;
+	Unlink(pool, type, i);
+}
+
+int SetEntityType(struct EntityPool* pool, int id, enum ENTITY_TYPE type) {
+	struct EntityRef ref = pool->refs[id];
+	if (ref.type == type) {
+		return ref.index;
+	}
+	int i = Append(pool, type, id);
+	if (i < 0) {
+		return -1;
+	}
+	struct EntityList *from = &pool->lists[ref.type], *to = &pool->lists[type];
+	to->x[i] = from->x[ref.index];
+	to->y[i] = from->y[ref.index];
+	to->angle[i] = from->angle[ref.index];
+	to->distance[i] = from->distance[ref.index];
+	to->dx[i] = from->dx[ref.index];
+	to->dy[i] = from->dy[ref.index];
+	to->score[i] = from->score[ref.index];
+	Unlink(pool, ref.type, ref.index);
+	return i;
+}
+
+void SetEntityAngle(struct EntityList* list, int i, double angle) {
+	list->angle[i] = angle;
+	list->dx[i] = sin(angle);
+	list->dy[i] = cos(angle);
+}
+
+bool ReserveEntityPool(struct EntityPool* pool, const int* counts, int id_capacity) {
+	for (int i = 0; i < TYPE_COUNT; i++) {
+		if ((counts[i] > pool->lists[i].capacity) && !ReserveList(&pool->lists[i], counts[i])) {
+			return false;
+		}
+	}
+	if (id_capacity <= pool->id_capacity) {
+		return true;
+	}
+	return Reserve((void**)&pool->refs, sizeof(struct EntityRef) * id_capacity) &&
+		Reserve((void**)&pool->free_ids, sizeof(int) * id_capacity);
+}
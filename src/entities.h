@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZENEKGIENEK_ENTITIES_H
+#define ZENEKGIENEK_ENTITIES_H
+
+#include <stdbool.h>
+
+enum ENTITY_TYPE {
+	TYPE_ENEMY,
+	TYPE_USER,
+	TYPE_BULLET,
+	TYPE_MESSAGE,
+	TYPE_FAKE,
+	TYPE_EXPLOSION,
+	TYPE_COUNT
+};
+
+// All entities of a single type, stored field by field.
+// `[0..count)` is always packed; removal swaps the last entity into the freed place.
+// `dx` and `dy` cache the direction vector of `angle` and are kept in sync by SetEntityAngle.
+struct EntityList {
+	double *x, *y, *angle, *distance;
+	double *dx, *dy;
+	int* score;
+	int* id;
+	int count, capacity;
+};
+
+struct EntityRef {
+	enum ENTITY_TYPE type;
+	int index;
+};
+
+// Entities partitioned by type. Every entity also has a stable id which survives
+// other entities being removed or itself changing its type; ids are recycled once
+// their entity is gone. Storage doubles when full - adding fails only when that
+// allocation fails.
+struct EntityPool {
+	struct EntityList lists[TYPE_COUNT];
+	struct EntityRef* refs; // id -> partition and position in it
+	int* free_ids;
+	int free_count, id_capacity;
+	int count;
+};
+
+struct EntityPool* CreateEntityPool(int capacity);
+void DestroyEntityPool(struct EntityPool* pool);
+int AddEntity(struct EntityPool* pool, enum ENTITY_TYPE type, double x, double y, double angle);
+void RemoveEntity(struct EntityPool* pool, enum ENTITY_TYPE type, int i);
+int SetEntityType(struct EntityPool* pool, int id, enum ENTITY_TYPE type);
+void SetEntityAngle(struct EntityList* list, int i, double angle);
+// Makes room for counts[type] entities of every type and for id_capacity ids,
+// never going below what's in use, so the pool stays valid if it fails. The
+// caller sets id_capacity and fills in lists, refs and free ids afterwards;
+// used when restoring snapshots.
+bool ReserveEntityPool(struct EntityPool* pool, const int* counts, int id_capacity);
+
+#endif
@@ -19,6 +19,9 @@
  */
 
 #include "../common.h"
+#include "../assetpack.h"
+#include "../pcmcache.h"
+#include <allegro5/allegro_opengl.h>
 #include <libsuperderpy.h>
 #include <math.h>
 
@@ -29,7 +32,9 @@ struct GamestateResources {
 	ALLEGRO_FONT* font;
 	ALLEGRO_SAMPLE *sample, *kbd_sample, *key_sample;
 	ALLEGRO_SAMPLE_INSTANCE *sound, *kbd, *key;
+	struct PCMCache* pcm;
 	ALLEGRO_BITMAP *bitmap, *checkerboard, *pixelator;
+	ALLEGRO_SHADER* shader; // does the zoom, tint and checkerboard in one pass; NULL if unavailable
 	int pos;
 	double fade, tan;
 	char text[255];
@@ -96,6 +101,7 @@ void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double
 }
 
 void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
+	ProfilerBegin(game->data->profiler, "dosowisko");
 	if (!data->fadeout) {
 		char t[255] = "";
 		strncpy(t, data->text, 255);
@@ -115,23 +121,41 @@ void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 
 		int fade = data->fadeout ? 255 : (int)(data->fade);
 
-		al_set_target_bitmap(data->pixelator);
-		al_clear_to_color(al_map_rgb(35, 31, 32));
+		if (data->shader) {
+			SetFramebufferAsTarget(game);
+			al_use_shader(data->shader);
+			int tw, th;
+			al_get_opengl_texture_size(data->bitmap, &tw, &th);
+			al_set_shader_float_vector("size", 2, (float[]){320, 180}, 1);
+			al_set_shader_float_vector("extent", 2, (float[]){320.0 / tw, 180.0 / th}, 1);
+			al_set_shader_float_vector("viewport", 2, (float[]){game->viewport.width, game->viewport.height}, 1);
+			al_set_shader_float_vector("background", 3, (float[]){35 / 255.0, 31 / 255.0, 32 / 255.0}, 1);
+			al_set_shader_float("fade", fade / 255.0);
+			al_set_shader_float("zoom", tg);
+			al_draw_scaled_bitmap(data->bitmap, 0, 0, 320, 180, 0, 0, game->viewport.width, game->viewport.height, 0);
+			al_use_shader(NULL);
+		} else {
+			al_set_target_bitmap(data->pixelator);
+			al_clear_to_color(al_map_rgb(35, 31, 32));
 
-		al_draw_tinted_scaled_bitmap(data->bitmap, al_map_rgba(fade, fade, fade, fade), 0, 0,
-			al_get_bitmap_width(data->bitmap), al_get_bitmap_height(data->bitmap),
-			-tg * al_get_bitmap_width(data->bitmap) * 0.05,
-			-tg * al_get_bitmap_height(data->bitmap) * 0.05,
-			al_get_bitmap_width(data->bitmap) + tg * 0.1 * al_get_bitmap_width(data->bitmap),
-			al_get_bitmap_height(data->bitmap) + tg * 0.1 * al_get_bitmap_height(data->bitmap),
-			0);
+			al_draw_tinted_scaled_bitmap(data->bitmap, al_map_rgba(fade, fade, fade, fade), 0, 0,
+				al_get_bitmap_width(data->bitmap), al_get_bitmap_height(data->bitmap),
+				-tg * al_get_bitmap_width(data->bitmap) * 0.05,
+				-tg * al_get_bitmap_height(data->bitmap) * 0.05,
+				al_get_bitmap_width(data->bitmap) + tg * 0.1 * al_get_bitmap_width(data->bitmap),
+				al_get_bitmap_height(data->bitmap) + tg * 0.1 * al_get_bitmap_height(data->bitmap),
+				0);
 
-		al_draw_bitmap(data->checkerboard, 0, 0, 0);
+			if (data->checkerboard) {
+				al_draw_bitmap(data->checkerboard, 0, 0, 0);
+			}
 
-		SetFramebufferAsTarget(game);
+			SetFramebufferAsTarget(game);
 
-		al_draw_scaled_bitmap(data->pixelator, 0, 0, 320, 180, 0, 0, game->viewport.width, game->viewport.height, 0);
+			al_draw_scaled_bitmap(data->pixelator, 0, 0, 320, 180, 0, 0, game->viewport.width, game->viewport.height, 0);
+		}
 	}
+	ProfilerEnd(game->data->profiler);
 }
 
 void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
@@ -163,33 +187,38 @@ void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data,
 }
 
 void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
+	UseAssetPack(); // this may be the loading thread
 	struct GamestateResources* data = malloc(sizeof(struct GamestateResources));
 	int flags = al_get_new_bitmap_flags();
 	al_set_new_bitmap_flags(flags & ~ALLEGRO_MAG_LINEAR);
 
 	data->timeline = TM_Init(game, data, "main");
 	data->bitmap = CreateNotPreservedBitmap(320, 180);
-	data->pixelator = CreateNotPreservedBitmap(320, 180);
-	data->checkerboard = al_create_bitmap(320, 180);
+	data->pixelator = NULL; // only needed without the shader
+	data->checkerboard = NULL;
+	data->shader = NULL;
 	(*progress)(game);
 
 	data->font = al_load_ttf_font(GetDataFilePath(game, "fonts/DejaVuSansMono.ttf"),
 		(int)(180 * 0.1666 / 8) * 8, 0);
 	(*progress)(game);
 
-	data->sample = al_load_sample(GetDataFilePath(game, "dosowisko.flac"));
+	char* pcm_path = FindDataFilePath(game, "samples.pcm");
+	data->pcm = OpenPCMCache(pcm_path);
+	free(pcm_path);
+	data->sample = LoadCachedSample(data->pcm, "dosowisko.flac", GetDataFilePath(game, "dosowisko.flac"));
 	data->sound = al_create_sample_instance(data->sample);
 	al_attach_sample_instance_to_mixer(data->sound, game->audio.music);
 	al_set_sample_instance_playmode(data->sound, ALLEGRO_PLAYMODE_ONCE);
 	(*progress)(game);
 
-	data->kbd_sample = al_load_sample(GetDataFilePath(game, "kbd.flac"));
+	data->kbd_sample = LoadCachedSample(data->pcm, "kbd.flac", GetDataFilePath(game, "kbd.flac"));
 	data->kbd = al_create_sample_instance(data->kbd_sample);
 	al_attach_sample_instance_to_mixer(data->kbd, game->audio.fx);
 	al_set_sample_instance_playmode(data->kbd, ALLEGRO_PLAYMODE_ONCE);
 	(*progress)(game);
 
-	data->key_sample = al_load_sample(GetDataFilePath(game, "key.flac"));
+	data->key_sample = LoadCachedSample(data->pcm, "key.flac", GetDataFilePath(game, "key.flac"));
 	data->key = al_create_sample_instance(data->key_sample);
 	al_attach_sample_instance_to_mixer(data->key, game->audio.fx);
 	al_set_sample_instance_playmode(data->key, ALLEGRO_PLAYMODE_ONCE);
@@ -200,20 +229,61 @@ void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 	return data;
 }
 
-void Gamestate_PostLoad(struct Game* game, struct GamestateResources* data) {
-	al_set_target_bitmap(data->checkerboard);
-	al_lock_bitmap(data->checkerboard, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_WRITEONLY);
-	int x, y;
-	for (x = 0; x < al_get_bitmap_width(data->checkerboard); x = x + 2) {
-		for (y = 0; y < al_get_bitmap_height(data->checkerboard); y = y + 2) {
-			al_put_pixel(x, y, al_map_rgba(0, 0, 0, 64));
-			al_put_pixel(x + 1, y, al_map_rgba(0, 0, 0, 0));
-			al_put_pixel(x, y + 1, al_map_rgba(0, 0, 0, 0));
-			al_put_pixel(x + 1, y + 1, al_map_rgba(0, 0, 0, 0));
+static ALLEGRO_SHADER* CreatePixelatorShader(struct Game* game) {
+	// GLSL only; Direct3D builds take the fallback path
+	if (!(al_get_display_flags(game->display) & ALLEGRO_OPENGL)) {
+		return NULL;
+	}
+	ALLEGRO_SHADER* shader = al_create_shader(ALLEGRO_SHADER_GLSL);
+	if (!shader) {
+		return NULL;
+	}
+	if (!al_attach_shader_source_file(shader, ALLEGRO_VERTEX_SHADER, GetDataFilePath(game, "shaders/vertex.glsl")) ||
+		!al_attach_shader_source_file(shader, ALLEGRO_PIXEL_SHADER, GetDataFilePath(game, "shaders/pixelator.glsl")) ||
+		!al_build_shader(shader)) {
+		PrintConsole(game, "Pixelator shader unavailable, drawing layers separately: %s", al_get_shader_log(shader));
+		al_destroy_shader(shader);
+		return NULL;
+	}
+	return shader;
+}
+
+// Every even pixel of every even row gets darkened; written row by row instead of pixel by pixel.
+static void FillCheckerboard(ALLEGRO_BITMAP* bitmap) {
+	int w = al_get_bitmap_width(bitmap), h = al_get_bitmap_height(bitmap);
+	ALLEGRO_LOCKED_REGION* region = al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888, ALLEGRO_LOCK_WRITEONLY);
+	if (!region) {
+		return;
+	}
+	uint32_t* dark = calloc(w, sizeof(uint32_t));
+	for (int x = 0; x < w; x += 2) {
+		dark[x] = 0x40000000; // premultiplied black at alpha 64
+	}
+	for (int y = 0; y < h; y++) {
+		uint32_t* row = (uint32_t*)((char*)region->data + y * region->pitch);
+		if (y % 2 == 0) {
+			memcpy(row, dark, sizeof(uint32_t) * w);
+		} else {
+			memset(row, 0, sizeof(uint32_t) * w);
 		}
 	}
-	al_unlock_bitmap(data->checkerboard);
-	al_set_target_backbuffer(game->display);
+	free(dark);
+	al_unlock_bitmap(bitmap);
+}
+
+void Gamestate_PostLoad(struct Game* game, struct GamestateResources* data) {
+	data->shader = CreatePixelatorShader(game);
+	if (data->shader) {
+		return;
+	}
+	int flags = al_get_new_bitmap_flags();
+	al_set_new_bitmap_flags(flags & ~ALLEGRO_MAG_LINEAR);
+	data->pixelator = CreateNotPreservedBitmap(320, 180);
+	data->checkerboard = al_create_bitmap(320, 180);
+	al_set_new_bitmap_flags(flags);
+	if (data->checkerboard) {
+		FillCheckerboard(data->checkerboard);
+	}
 }
 
 void Gamestate_Stop(struct Game* game, struct GamestateResources* data) {
@@ -230,9 +300,17 @@ void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
 	al_destroy_sample(data->kbd_sample);
 	al_destroy_sample_instance(data->key);
 	al_destroy_sample(data->key_sample);
+	ClosePCMCache(data->pcm);
 	al_destroy_bitmap(data->bitmap);
-	al_destroy_bitmap(data->checkerboard);
-	al_destroy_bitmap(data->pixelator);
+	if (data->checkerboard) {
+		al_destroy_bitmap(data->checkerboard);
+	}
+	if (data->shader) {
+		al_destroy_shader(data->shader);
+	}
+	if (data->pixelator) {
+		al_destroy_bitmap(data->pixelator);
+	}
 	TM_Destroy(data->timeline);
 	free(data);
 }
@@ -241,6 +319,8 @@ void Gamestate_Reload(struct Game* game, struct GamestateResources* data) {
 	int flags = al_get_new_bitmap_flags();
 	al_set_new_bitmap_flags(flags & ~ALLEGRO_MAG_LINEAR);
 	data->bitmap = CreateNotPreservedBitmap(320, 180);
-	data->pixelator = CreateNotPreservedBitmap(320, 180);
+	if (!data->shader) {
+		data->pixelator = CreateNotPreservedBitmap(320, 180);
+	}
 	al_set_new_bitmap_flags(flags);
 }
@@ -19,138 +19,161 @@
  */
 
 #include "../common.h"
+#include "../assetpack.h"
+#include "../atlas.h"
+#include "../loadpool.h"
+#include "../numbers.h"
+#include "../pcmcache.h"
+#include "../projection.h"
+#include "../replay.h"
+#include "../script.h"
+#include "../sfx.h"
+#include "../sim.h"
+#include "../simworker.h"
+#include "../snapshot.h"
+#include "../voicepool.h"
 #include <libsuperderpy.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
-
-enum ENTITY_TYPE {
-	TYPE_ENEMY,
-	TYPE_USER,
-	TYPE_BULLET,
-	TYPE_MESSAGE,
-	TYPE_FAKE,
-	TYPE_EXPLOSION
-};
-
-struct Entity {
-	double x, y, angle, distance;
-	enum ENTITY_TYPE type;
-	bool used;
-	int score;
-};
+#include <string.h>
+#include <time.h>
 
 struct GamestateResources {
 	// This struct is for every resource allocated and used by your gamestate.
 	// It gets created on load and then gets passed around to all other function calls.
 
-	ALLEGRO_BITMAP *internet, *bg, *pixelator;
+	ALLEGRO_BITMAP *bg, *pixelator;
 	ALLEGRO_FONT *font, *bff;
-	double x, y, angle;
 	int w, h;
 
-	int score;
-
-	bool spawning;
-
-	bool up, left, down, right;
+	int input;
 
 	struct Character *car, *police, *teeth, *user, *fake, *news, *bad, *explosion;
 
-	struct Timeline* timeline;
+	struct Atlas* atlas; // frames of all the entity characters
+	struct VertexBatch sprites, shapes, digits;
+	struct NumberFont* numbers;
 
-	struct Entity entities[8192];
-	int entities_count;
+	struct {
+		double *wx, *wy; // interpolated world positions
+		float *x, *y, *z;
+		int* visible;
+		int capacity;
+	} projected; // screen positions of an entity list, reused across frames
 
-	int fake_counter;
+	struct Timeline* timeline;
+	struct Script *intro, *outro;
+	struct {
+		struct Script* script;
+		int pos; // next step to be added to the timeline
+		int current; // step being played right now
+	} running;
+	struct VoicePool* voices;
+	struct TM_Action* speaking; // Speak action that took its voice; owns the stream unless it failed
+	ALLEGRO_AUDIO_STREAM* voice;
+
+	struct SimWorker* worker;
+	struct JobPool* jobs; // for the heavy phases of the sim
+	struct Replay* record; // everything since Start, saved with F6
+	struct Replay* replay; // being played instead of live input, if any
+	double accumulator;
+	int heard_explosions; // compared with SimFrame.explosions
+	bool sim_failed; // SimFrame.failed as of the last frame, to complain once
+	void* retry; // snapshot taken when the game started
+	size_t retry_size;
 
 	double wskaznik;
 
-	int count;
-	int pew;
-	int tilt;
 	bool showscore;
 
-	bool move;
 	bool showlogo;
 	ALLEGRO_BITMAP *logo, *endscreen, *endscreen1, *endscreen2, *endscreen3;
 	ALLEGRO_AUDIO_STREAM *music1, *music2;
-	int fade;
+	int music; // which one is playing, 0 for none
 
-	struct {
-		ALLEGRO_SAMPLE* sample;
-		ALLEGRO_SAMPLE_INSTANCE* sound;
-		bool used;
-	} bullets[10];
+	struct PCMCache* pcm;
 
-	struct {
-		ALLEGRO_SAMPLE* sample;
-		ALLEGRO_SAMPLE_INSTANCE* sound;
-		bool used;
-	} explosions[8];
+	ALLEGRO_SAMPLE *bullets[10], *explosions[8];
+	struct SfxPool* sfx;
 
 	bool ended;
 };
 
-int Gamestate_ProgressCount = 46; // number of loading steps as reported by Gamestate_Load
+// The background is only drawn up to this far from the player; further than
+// that, it shrinks into a few pixels at the horizon anyway.
+#define BG_TILE_SIZE 256
+#define BG_MAX_DISTANCE 1024
+#define BG_MAX_TILES ((2 * BG_MAX_DISTANCE / BG_TILE_SIZE + 1) * (2 * BG_MAX_DISTANCE / BG_TILE_SIZE + 1))
+
+// How many voice lines of a script are on the timeline (and so being opened) ahead of the current one.
+#define SCRIPT_VOICES_AHEAD 2
+
+// Stored along with the sim in snapshots. Timelines can't be serialized, so
+// the intro gets restored by re-queuing it from the step that was playing.
+struct GameSnapshot {
+	int32_t step;
+	int32_t music;
+	int32_t showlogo;
+};
+
+int Gamestate_ProgressCount = 45; // number of loading steps as reported by Gamestate_Load
 
 /* Function: al_transform_coordinates_4d
  */
 void al_transform_coordinates_4d(const ALLEGRO_TRANSFORM* trans,
 	float* x, float* y, float* z, float* w) {
-	float rx, ry, rz, rw;
-
-#define M(i, j) trans->m[i][j]
-
-	rx = M(0, 0) * *x + M(1, 0) * *y + M(2, 0) * *z + M(3, 0) * *w;
-	ry = M(0, 1) * *x + M(1, 1) * *y + M(2, 1) * *z + M(3, 1) * *w;
-	rz = M(0, 2) * *x + M(1, 2) * *y + M(2, 2) * *z + M(3, 2) * *w;
-	rw = M(0, 3) * *x + M(1, 3) * *y + M(2, 3) * *z + M(3, 3) * *w;
-
-#undef M
-
-	*x = rx;
-	*y = ry;
-	*z = rz;
-	*w = rw;
+	TransformCoordinates4D(trans->m, x, y, z, w);
 }
 
 /* Function: al_transform_coordinates_3d_projective
  */
 void al_transform_coordinates_3d_projective(const ALLEGRO_TRANSFORM* trans,
 	float* x, float* y, float* z) {
-	float w = 1;
-	al_transform_coordinates_4d(trans, x, y, z, &w);
-	*x /= w;
-	*y /= w;
-	*z /= w;
+	TransformCoordinates3DProjective(trans->m, x, y, z);
 }
 
 static TM_ACTION(Speak) {
-	ALLEGRO_AUDIO_STREAM* stream = TM_GetArg(action->arguments, 0);
+	char* filename = TM_GetArg(action->arguments, 0);
 	char* text = TM_GetArg(action->arguments, 1);
 	char* person = TM_GetArg(action->arguments, 2);
 
 	if (action->state == TM_ACTIONSTATE_INIT) {
-		al_set_audio_stream_playing(stream, false);
-		al_set_audio_stream_playmode(stream, ALLEGRO_PLAYMODE_ONCE);
+		RequestVoice(data->voices, filename);
 	}
 
-	if (action->state == TM_ACTIONSTATE_START) {
+	if ((action->state == TM_ACTIONSTATE_START) || ((action->state == TM_ACTIONSTATE_RUNNING) && (data->speaking != action))) {
+		// the stream may still be opening in the background; keep the timeline waiting until it's there
+		enum VOICE_STATUS status = TakeVoice(data->voices, filename, &data->voice);
+		if (status == VOICE_PENDING) {
+			return false;
+		}
+		data->speaking = action; // either way the request is gone, so it mustn't be cancelled
+		if (status == VOICE_FAILED) {
+			return true;
+		}
 		game->data->skip = false;
-		game->data->text = text;
-		game->data->person = person;
-		//al_rewind_audio_stream(stream);
-		al_attach_audio_stream_to_mixer(stream, game->audio.voice);
-		al_set_audio_stream_playing(stream, true);
+		ShowSubtitle(game, data->font, person, text);
+		al_attach_audio_stream_to_mixer(data->voice, game->audio.voice);
+		al_set_audio_stream_playing(data->voice, true);
+		return false;
 	}
 
 	if (action->state == TM_ACTIONSTATE_RUNNING) {
-		return !al_get_audio_stream_playing(stream) || game->data->skip;
+		return !al_get_audio_stream_playing(data->voice) || game->data->skip;
 	}
 
 	if (action->state == TM_ACTIONSTATE_DESTROY) {
-		al_destroy_audio_stream(stream);
-		game->data->text = NULL;
+		if (data->speaking == action) {
+			if (data->voice) {
+				al_destroy_audio_stream(data->voice);
+				data->voice = NULL;
+				HideSubtitle(game);
+			}
+			data->speaking = NULL;
+		} else {
+			CancelVoice(data->voices, filename);
+		}
 	}
 	return false;
 }
@@ -158,18 +181,20 @@ static TM_ACTION(Speak) {
 static TM_ACTION(ShowLogo) {
 	if (action->state == TM_ACTIONSTATE_START) {
 		data->showlogo = true;
-		int s = rand() % 8;
-		al_stop_sample_instance(data->explosions[s].sound);
-		al_play_sample_instance(data->explosions[s].sound);
+		PlaySfx(data->sfx, data->explosions[rand() % 8], 1.0);
 	}
 	return true;
 }
 
 static TM_ACTION(SwitchEndScreen) {
-	ALLEGRO_BITMAP* screen = TM_GetArg(action->arguments, 0);
+	const char* screen = TM_GetArg(action->arguments, 0);
 
 	if (action->state == TM_ACTIONSTATE_START) {
-		data->endscreen = screen;
+		ALLEGRO_BITMAP* screens[] = {data->endscreen1, data->endscreen2, data->endscreen3};
+		int i = screen ? atoi(screen) : 0;
+		if ((i >= 1) && (i <= 3)) {
+			data->endscreen = screens[i - 1];
+		}
 	}
 	return true;
 }
@@ -181,57 +206,61 @@ static TM_ACTION(HideLogo) {
 	return true;
 }
 
-static TM_ACTION(StartGame) {
-	if (action->state == TM_ACTIONSTATE_START) {
-		data->move = true;
-		al_set_audio_stream_playing(data->music1, true);
-		al_set_audio_stream_playing(data->music2, false);
+// For commands that come from the timeline rather than from the player.
+// They're taken from the replay instead when there is one, as the timeline
+// runs on wall clock time and wouldn't line up with the same ticks again.
+static void QueueCommand(struct GamestateResources* data, enum SIM_COMMAND_TYPE type, int arg) {
+	if (data->replay) {
+		return;
 	}
-	return true;
+	if (data->record) {
+		RecordReplayEvent(data->record, data->worker->requested, REPLAY_COMMAND, type, arg);
+	}
+	QueueSimCommand(data->worker, type, arg);
 }
 
-static TM_ACTION(ShowScore) {
-	if (action->state == TM_ACTIONSTATE_START) {
-		data->showscore = true;
-		int s = rand() % 8;
-		al_stop_sample_instance(data->explosions[s].sound);
-		al_play_sample_instance(data->explosions[s].sound);
-	}
-	return true;
+static void PlayMusic(struct GamestateResources* data, int music) {
+	al_set_audio_stream_playing(data->music1, music == 1);
+	al_set_audio_stream_playing(data->music2, music == 2);
+	data->music = music;
 }
 
-static struct Entity* SpawnEntity(struct Game* game, struct GamestateResources* data, double x, double y, double angle, enum ENTITY_TYPE type) {
-	while (data->entities[data->entities_count].used) {
-		data->entities_count++;
-		if (data->entities_count >= 8192) {
-			data->entities_count = 0;
-		}
+static size_t SaveGame(struct GamestateResources* data, int step, void** buffer) {
+	struct GameSnapshot extra = {.step = step, .music = data->music, .showlogo = data->showlogo};
+	struct Sim* sim = SyncSim(data->worker);
+	size_t size = GetSimSnapshotSize(sim, sizeof(extra));
+	*buffer = malloc(size);
+	if (!*buffer || !SaveSimSnapshot(sim, &extra, sizeof(extra), *buffer, size)) {
+		free(*buffer);
+		*buffer = NULL;
+		return 0;
 	}
+	return size;
+}
 
-	int id = data->entities_count;
-	data->entities[id].used = true;
-	data->entities[id].type = type;
-	data->entities[id].x = x;
-	data->entities[id].y = y;
-	data->entities[id].angle = angle;
-	data->entities[id].distance = 0;
+static TM_ACTION(StartGame) {
+	if (action->state == TM_ACTIONSTATE_START) {
+		QueueCommand(data, SIM_COMMAND_START, 0);
+		PlayMusic(data, 1);
 
-	data->entities_count++;
-	if (data->entities_count >= 8192) {
-		data->entities_count = 0;
+		// retrying picks up right after this step
+		free(data->retry);
+		data->retry_size = SaveGame(data, data->running.current + 1, &data->retry);
 	}
+	return true;
+}
 
-	if (type == TYPE_FAKE) {
-		data->fake_counter++;
+static TM_ACTION(ShowScore) {
+	if (action->state == TM_ACTIONSTATE_START) {
+		data->showscore = true;
+		PlaySfx(data->sfx, data->explosions[rand() % 8], 1.0);
 	}
-
-	return &data->entities[id];
+	return true;
 }
 
 static TM_ACTION(PlayGameMusic) {
 	if (action->state == TM_ACTIONSTATE_START) {
-		al_set_audio_stream_playing(data->music1, false);
-		al_set_audio_stream_playing(data->music2, true);
+		PlayMusic(data, 2);
 	}
 
 	return true;
@@ -239,226 +268,441 @@ static TM_ACTION(PlayGameMusic) {
 
 static TM_ACTION(SpawnEnemies) {
 	if (action->state == TM_ACTIONSTATE_START) {
-		for (int i = 0; i < 32; i++) {
-			double angle = rand() / ALLEGRO_PI;
-			SpawnEntity(game, data, data->x + sin(angle) * (222 + rand() % 300), data->y + cos(angle) * (222 + rand() % 300), rand() / ALLEGRO_PI, TYPE_USER);
-		}
-		for (int i = 0; i < 4; i++) {
-			double angle = rand() / ALLEGRO_PI;
-			SpawnEntity(game, data, data->x + sin(angle) * (222 + rand() % 300), data->y + cos(angle) * (222 + rand() % 300), rand() / ALLEGRO_PI, TYPE_MESSAGE);
-		}
-		for (int i = 0; i < 2; i++) {
-			double angle = rand() / ALLEGRO_PI;
-			SpawnEntity(game, data, data->x + sin(angle) * (222 + rand() % 300), data->y + cos(angle) * (222 + rand() % 300), rand() / ALLEGRO_PI, TYPE_ENEMY);
-		}
-		data->spawning = true;
+		QueueCommand(data, SIM_COMMAND_SPAWN_WAVE, 0);
 	}
 	return true;
 }
 
 static TM_ACTION(SpawnSingleFake) {
 	if (action->state == TM_ACTIONSTATE_START) {
-		SpawnEntity(game, data, data->x + sin(data->angle) * 200, data->y + cos(data->angle) * 200, rand() / ALLEGRO_PI, TYPE_FAKE);
+		QueueCommand(data, SIM_COMMAND_SPAWN_FAKE, 0);
 	}
 	return true;
 }
 
 static TM_ACTION(SpawnSingleEnemy) {
 	if (action->state == TM_ACTIONSTATE_START) {
-		SpawnEntity(game, data, data->x + sin(data->angle) * 200, data->y + cos(data->angle) * 200, rand() / ALLEGRO_PI, TYPE_ENEMY);
+		QueueCommand(data, SIM_COMMAND_SPAWN_ENEMY, 0);
 	}
 	return true;
 }
 
-void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double delta) {
-	// Called 60 times per second (by default). Here you should do all your game logic.
-	TM_Process(data->timeline, delta);
+// Actions that can be used in cutscene scripts by name.
+static const struct {
+	const char* name;
+	bool (*action)(struct Game*, struct GamestateResources*, struct TM_Action*);
+} ScriptActions[] = {
+	{"ShowLogo", ShowLogo},
+	{"HideLogo", HideLogo},
+	{"StartGame", StartGame},
+	{"PlayGameMusic", PlayGameMusic},
+	{"SpawnEnemies", SpawnEnemies},
+	{"SpawnSingleFake", SpawnSingleFake},
+	{"SpawnSingleEnemy", SpawnSingleEnemy},
+	{"SwitchEndScreen", SwitchEndScreen},
+	{"ShowScore", ShowScore},
+};
 
-	if (data->ended) {
-		return;
+static int FindScriptAction(const char* name) {
+	for (size_t i = 0; i < sizeof(ScriptActions) / sizeof(ScriptActions[0]); i++) {
+		if (strcmp(ScriptActions[i].name, name) == 0) {
+			return i;
+		}
 	}
+	return -1;
+}
 
-	data->count++;
+static void QueueScript(struct Game* game, struct GamestateResources* data);
 
-	if (!data->move) {
-		return;
+static TM_ACTION(ContinueScript) {
+	TM_RunningOnly;
+	QueueScript(game, data);
+	return true;
+}
+
+static TM_ACTION(MarkScript) {
+	TM_RunningOnly;
+	data->running.current = (intptr_t)TM_GetArg(action->arguments, 0);
+	return true;
+}
+
+// Adds the running script to the timeline up to and including its next voice
+// line, followed by a marker that adds the next part once this one has played.
+// Voice streams get requested as soon as their Speak is added, so this keeps
+// them being opened a few lines in advance rather than all at once.
+static void QueueScript(struct Game* game, struct GamestateResources* data) {
+	struct Script* script = data->running.script;
+	while (data->running.pos < script->steps_count) {
+		intptr_t index = data->running.pos++;
+		struct ScriptStep* step = &script->steps[index];
+		TM_AddAction(data->timeline, &MarkScript, TM_AddToArgs(NULL, 1, (void*)index));
+		switch (step->op) {
+			case SCRIPT_DELAY:
+				TM_AddDelay(data->timeline, step->delay);
+				break;
+			case SCRIPT_SPEAK:
+				TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, (char*)GetScriptString(script, step->voice),
+					(char*)GetScriptString(script, step->subtitle), (char*)GetScriptString(script, step->person)));
+				if (data->running.pos < script->steps_count) {
+					TM_AddAction(data->timeline, &ContinueScript, NULL);
+					return;
+				}
+				break;
+			case SCRIPT_ACTION: {
+				int i = FindScriptAction(GetScriptString(script, step->action));
+				if (i < 0) {
+					break; // already reported at load time
+				}
+				TM_AddAction(data->timeline, ScriptActions[i].action,
+					(step->arg != SCRIPT_NO_ARG) ? TM_AddToArgs(NULL, 1, (char*)GetScriptString(script, step->arg)) : NULL);
+				break;
+			}
+		}
+		if (data->running.pos == script->steps_count) {
+			TM_AddAction(data->timeline, &MarkScript, TM_AddToArgs(NULL, 1, (void*)(intptr_t)script->steps_count));
+		}
 	}
+}
 
-	if (data->fade < 255) {
-		data->fade++;
+static void RunScript(struct Game* game, struct GamestateResources* data, struct Script* script, int step) {
+	data->running.script = script;
+	data->running.pos = step;
+	data->running.current = step;
+	for (int i = 0; i < SCRIPT_VOICES_AHEAD; i++) {
+		QueueScript(game, data);
 	}
+}
 
-	if (data->fake_counter > 64) {
-		int s = rand() % 8;
-		al_stop_sample_instance(data->explosions[s].sound);
-		al_play_sample_instance(data->explosions[s].sound);
-		al_set_audio_stream_playing(data->music1, false);
-		al_set_audio_stream_playing(data->music2, false);
+static struct Script* LoadCutscene(struct Game* game, const char* name) {
+	char filename[255];
+	snprintf(filename, 255, "scripts/%s.txt", name);
+	char* source = FindDataFilePath(game, filename);
+	snprintf(filename, 255, "scripts/%s.bin", name);
+	char* table = FindDataFilePath(game, filename);
+	struct Script* script = LoadScript(source, table);
+	free(source);
+	free(table);
+	if (!script) {
+		FatalError(game, true, "Couldn't load script %s!", name);
+		return NULL;
+	}
+	for (int i = 0; i < script->steps_count; i++) {
+		if ((script->steps[i].op == SCRIPT_ACTION) && (FindScriptAction(GetScriptString(script, script->steps[i].action)) < 0)) {
+			PrintConsole(game, "Script %s: unknown action %s, skipping.", name, GetScriptString(script, script->steps[i].action));
+		}
+	}
+	return script;
+}
 
-		data->ended = true;
-		TM_CleanQueue(data->timeline);
-		TM_AddDelay(data->timeline, 2);
+static void GameOver(struct Game* game, struct GamestateResources* data) {
+	PlaySfx(data->sfx, data->explosions[rand() % 8], 1.0);
+	PlayMusic(data, 0);
 
-		TM_AddAction(data->timeline, &SwitchEndScreen, TM_AddToArgs(NULL, 1, data->endscreen1));
+	data->ended = true;
+	TM_CleanQueue(data->timeline);
+	RunScript(game, data, data->outro, 0);
+}
 
-		TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/outro1.flac"), 4, 1024), "", ""));
-		TM_AddAction(data->timeline, &SwitchEndScreen, TM_AddToArgs(NULL, 1, data->endscreen2));
+// Puts the game back into the state from a snapshot, without reloading or
+// restarting anything. The intro continues from where it was.
+static bool RestoreGame(struct Game* game, struct GamestateResources* data, const void* buffer, size_t size) {
+	struct GameSnapshot extra = {.step = -1}; // for snapshots saved by the headless runner
+	if (!buffer || !RestoreSimSnapshot(SyncSim(data->worker), buffer, size, &extra, sizeof(extra))) {
+		return false;
+	}
+	PublishSimFrame(data->worker);
 
-		TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/outro2.flac"), 4, 1024), "", ""));
+	// neither of them can go on from a different state
+	if (data->record) {
+		DestroyReplay(data->record);
+		data->record = NULL;
+		PrintConsole(game, "Restored a snapshot, input recording stopped.");
+	}
+	if (data->replay) {
+		DestroyReplay(data->replay);
+		data->replay = NULL;
+		PrintConsole(game, "Restored a snapshot, replay stopped.");
+	}
+
+	TM_CleanQueue(data->timeline);
+	StopAllSfx(data->sfx);
+	data->ended = false;
+	data->endscreen = NULL;
+	data->showscore = false;
+	data->showlogo = extra.showlogo;
+	data->accumulator = 0;
+	data->sim_failed = false; // restoring clears Sim.failed too
+
+	if (extra.music) {
+		al_rewind_audio_stream(extra.music == 1 ? data->music1 : data->music2);
+	}
+	PlayMusic(data, extra.music);
 
-		TM_AddAction(data->timeline, &SwitchEndScreen, TM_AddToArgs(NULL, 1, data->endscreen3));
+	// keys held right now matter more than the ones held when saving
+	QueueSimCommand(data->worker, SIM_COMMAND_INPUT, data->input);
 
-		TM_AddAction(data->timeline, &ShowScore, NULL);
-		return;
+	if ((extra.step >= 0) && (extra.step <= data->intro->steps_count)) {
+		RunScript(game, data, data->intro, extra.step);
 	}
+	return true;
+}
 
-	AnimateCharacter(game, data->car, delta, 1.0);
-	AnimateCharacter(game, data->teeth, delta, 1.0);
-	AnimateCharacter(game, data->user, delta, 1.0);
-	AnimateCharacter(game, data->fake, delta, 1.0);
-	AnimateCharacter(game, data->news, delta, 1.0);
-	AnimateCharacter(game, data->bad, delta, 1.0);
-	AnimateCharacter(game, data->explosion, delta, 1.0);
+static char* GetQuicksavePath(void) {
+	ALLEGRO_PATH* path = al_get_standard_path(ALLEGRO_USER_DATA_PATH);
+	al_make_directory(al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP));
+	al_set_path_filename(path, "quicksave.snapshot");
+	char* filename = strdup(al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP));
+	al_destroy_path(path);
+	return filename;
+}
 
-	if (data->spawning) {
-		if (data->count % 60 * 10 == 0) {
-			double angle = rand() / ALLEGRO_PI;
-			SpawnEntity(game, data, data->x + sin(angle) * (222 + rand() % 300), data->y + cos(angle) * (222 + rand() % 300), rand() / ALLEGRO_PI, rand() % 4 == 0 ? TYPE_ENEMY : TYPE_USER);
-		}
+static void QuickSave(struct Game* game, struct GamestateResources* data) {
+	void* buffer;
+	size_t size = SaveGame(data, data->running.current, &buffer);
+	char* filename = GetQuicksavePath();
+	if (size && WriteSnapshotFile(filename, buffer, size)) {
+		PrintConsole(game, "Saved snapshot to %s", filename);
+	} else {
+		PrintConsole(game, "Could not save snapshot to %s!", filename);
 	}
+	free(filename);
+	free(buffer);
+}
 
-	if (data->left) {
-		data->angle -= 0.02;
+static void QuickLoad(struct Game* game, struct GamestateResources* data) {
+	size_t size = 0;
+	char* filename = GetQuicksavePath();
+	void* buffer = ReadSnapshotFile(filename, &size);
+	if (RestoreGame(game, data, buffer, size)) {
+		PrintConsole(game, "Loaded snapshot from %s", filename);
+	} else {
+		PrintConsole(game, "Could not load snapshot from %s!", filename);
 	}
+	free(filename);
+	free(buffer);
+}
 
-	if (data->right) {
-		data->angle += 0.02;
+// Everything the gameplay does with a key, whether it was pressed just now
+// or comes from a replay. Gets recorded along with the tick it takes effect at.
+static void HandleKey(struct Game* game, struct GamestateResources* data, enum REPLAY_KEY key, bool pressed) {
+	if (data->record) {
+		RecordReplayEvent(data->record, data->worker->requested, pressed ? REPLAY_PRESS : REPLAY_RELEASE, key, 0);
 	}
 
-	data->x += sin(data->angle) * 1;
-	data->y += cos(data->angle) * 1;
+	if (pressed && (key == REPLAY_KEY_ESCAPE)) {
+		UnloadCurrentGamestate(game); // mark this gamestate to be stopped and unloaded
+		// When there are no active gamestates, the engine will quit.
+	}
+
+	int bit = GetReplayKeyInput(key);
+	int input = pressed ? (data->input | bit) : (data->input & ~bit);
+	if (input != data->input) {
+		data->input = input;
+		QueueSimCommand(data->worker, SIM_COMMAND_INPUT, input);
+	}
 
-	if (data->up) {
-		data->x += sin(data->angle) * 1;
-		data->y += cos(data->angle) * 1;
+	if (pressed && (key == REPLAY_KEY_FULLSTOP)) {
+		game->data->skip = true;
 	}
 
-	if (data->down) {
-		data->x -= sin(data->angle) * 0.5;
-		data->y -= cos(data->angle) * 0.5;
+	if (key == REPLAY_KEY_SPACE) {
+		if (pressed) {
+			SelectSpritesheet(game, data->police, "ban");
+
+			QueueSimCommand(data->worker, SIM_COMMAND_FIRE, 0);
+
+			PlaySfx(data->sfx, data->bullets[rand() % 10], 1.0);
+		} else {
+			SelectSpritesheet(game, data->police, "normal");
+		}
 	}
+}
 
-	if (data->pew) {
-		data->pew--;
+// Feeds the replay events due before the next tick.
+static void PlayReplay(struct Game* game, struct GamestateResources* data) {
+	int tick = data->worker->requested;
+	for (const struct ReplayEvent* event = NextReplayEvent(data->replay, tick); event; event = NextReplayEvent(data->replay, tick)) {
+		if (event->kind == REPLAY_COMMAND) {
+			QueueSimCommand(data->worker, event->code, event->arg);
+		} else {
+			HandleKey(game, data, event->code, event->kind == REPLAY_PRESS);
+		}
 	}
+	if ((data->replay->pos == data->replay->events_count) && (tick >= data->replay->ticks)) {
+		PrintConsole(game, "Replay finished.");
+		DestroyReplay(data->replay);
+		data->replay = NULL;
+	}
+}
 
-	if (data->tilt) {
-		data->tilt--;
+static void SaveRecording(struct Game* game, struct GamestateResources* data) {
+	if (!data->record) {
+		PrintConsole(game, "Nothing is being recorded.");
+		return;
+	}
+	char filename[64];
+	time_t now = time(NULL);
+	strftime(filename, sizeof(filename), "replay-%Y%m%d-%H%M%S.zgreplay", localtime(&now));
+	ALLEGRO_PATH* path = al_get_standard_path(ALLEGRO_USER_DATA_PATH);
+	al_make_directory(al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP));
+	al_set_path_filename(path, filename);
+	data->record->ticks = data->worker->requested;
+	if (SaveReplay(data->record, al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP))) {
+		PrintConsole(game, "Saved replay to %s", al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP));
+	} else {
+		PrintConsole(game, "Could not save replay to %s!", al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP));
 	}
+	al_destroy_path(path);
+}
 
-	for (int j = 0; j < 8192; j++) {
-		if (data->entities[j].used) {
-			if ((data->entities[j].type != TYPE_BULLET) && (data->entities[j].type != TYPE_EXPLOSION)) {
-				if ((fabs(data->x - data->entities[j].x) < 12) && (fabs(data->y - data->entities[j].y) < 12)) {
-					if (data->entities[j].type == TYPE_FAKE) {
-						data->fake_counter--;
-						data->entities[j].score = 100;
-					} else if (data->entities[j].type != TYPE_ENEMY) {
-						data->fake_counter += 2;
-						data->entities[j].score = -500;
-					} else {
-						data->entities[j].score = 500;
-					}
-					data->score += data->entities[j].score;
-					int s = rand() % 8;
-					al_stop_sample_instance(data->explosions[s].sound);
-					al_play_sample_instance(data->explosions[s].sound);
+void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double delta) {
+	// Called 60 times per second (by default). Here you should do all your game logic.
+	struct Profiler* prof = game->data->profiler;
+	NextSfxFrame(data->sfx);
+	ProfilerBegin(prof, "timeline");
+	TM_Process(data->timeline, delta);
+	ProfilerEnd(prof);
 
-					data->entities[j].type = TYPE_EXPLOSION;
-					data->entities[j].distance = 0;
-					data->tilt += 20;
-					break;
-				}
-			}
-		}
+	if (data->ended) {
+		return;
 	}
 
-	for (int i = 0; i < 8192; i++) {
-		if (data->entities[i].used) {
-			if (data->entities[i].type == TYPE_BULLET) {
-				data->entities[i].x += sin(data->entities[i].angle) * 5;
-				data->entities[i].y += cos(data->entities[i].angle) * 5;
+	// The simulation advances in fixed steps regardless of how often we're called.
+	// After a long stall, give up on catching up instead of freezing for even longer.
+	data->accumulator = fmin(data->accumulator + delta, SIM_TICK * 8);
+	// the ticks run on the worker while this frame is being drawn
+	ProfilerBegin(prof, "simulation");
+	while (data->accumulator >= SIM_TICK) {
+		data->accumulator -= SIM_TICK;
+		if (data->replay) {
+			PlayReplay(game, data);
+		}
+		AdvanceSim(data->worker, 1);
+	}
+	ProfilerEnd(prof);
 
-				data->entities[i].distance += sqrt(pow(sin(data->entities[i].angle) * 5, 2) + pow(cos(data->entities[i].angle) * 5, 2));
+	// reacting to whatever the worker managed to finish so far
+	const struct SimFrame* frame = TakeSimFrame(data->worker);
+	for (; data->heard_explosions < frame->explosions; data->heard_explosions++) {
+		PlaySfx(data->sfx, data->explosions[rand() % 8], 1.0);
+	}
+	if (frame->failed && !data->sim_failed) {
+		PrintConsole(game, "Simulation ran out of memory, it won't play out as it should anymore!");
+	}
+	data->sim_failed = frame->failed;
 
-				if (data->entities[i].distance > 300) {
-					data->entities[i].used = false;
-				}
+	if (frame->ended) {
+		GameOver(game, data);
+		return;
+	}
 
-				for (int j = 0; j < 8192; j++) {
-					if (data->entities[j].used) {
-						if ((data->entities[j].type != TYPE_BULLET) && (data->entities[j].type != TYPE_EXPLOSION)) {
-							if ((fabs(data->entities[i].x - data->entities[j].x) < 8) && (fabs(data->entities[i].y - data->entities[j].y) < 8)) {
-								if (data->entities[j].type == TYPE_FAKE) {
-									data->fake_counter--;
-									data->entities[j].score = 100;
-								} else if (data->entities[j].type != TYPE_ENEMY) {
-									data->fake_counter += 2;
-									data->entities[j].score = -500;
-								} else {
-									data->entities[j].score = 500;
-								}
-								data->score += data->entities[j].score;
-
-								int s = rand() % 8;
-								al_stop_sample_instance(data->explosions[s].sound);
-								al_play_sample_instance(data->explosions[s].sound);
-
-								data->entities[j].type = TYPE_EXPLOSION;
-								data->entities[j].distance = 0;
-								data->entities[i].used = false;
-								data->tilt += 20;
-								break;
-							}
-						}
-					}
-				}
-			}
+	if (!frame->started) {
+		return;
+	}
 
-			if ((data->entities[i].type == TYPE_USER) || (data->entities[i].type == TYPE_ENEMY)) {
-				data->entities[i].x += sin(data->entities[i].angle) * 0.5;
-				data->entities[i].y += cos(data->entities[i].angle) * 0.5;
+	AnimateCharacter(game, data->car, delta, 1.0);
+	AnimateCharacter(game, data->teeth, delta, 1.0);
+	AnimateCharacter(game, data->user, delta, 1.0);
+	AnimateCharacter(game, data->fake, delta, 1.0);
+	AnimateCharacter(game, data->news, delta, 1.0);
+	AnimateCharacter(game, data->bad, delta, 1.0);
+	AnimateCharacter(game, data->explosion, delta, 1.0);
+}
 
-				data->entities[i].distance += sqrt(pow(sin(data->entities[i].angle) * 0.5, 2) + pow(cos(data->entities[i].angle) * 0.5, 2));
+// Draws bg.png repeated over the part of the world that can be seen through
+// projview, as tiles of BG_TILE_SIZE. Texture coordinates are in world units,
+// so the texture just wraps around and no tile needs its own bitmap.
+static void DrawBackground(struct GamestateResources* data, const ALLEGRO_TRANSFORM* projview, double cx, double cy) {
+	static const float corners[4][2] = {{-1, -1}, {1, -1}, {1, 1}, {-1, 1}};
+	float x0 = cx, y0 = cy, x1 = cx, y1 = cy;
+	for (int i = 0; i < 4; i++) {
+		float x, y;
+		if (!UnprojectToGround(projview->m, corners[i][0], corners[i][1], &x, &y)) {
+			// looking past the horizon, so take everything up to the fog distance
+			x0 = cx - BG_MAX_DISTANCE;
+			y0 = cy - BG_MAX_DISTANCE;
+			x1 = cx + BG_MAX_DISTANCE;
+			y1 = cy + BG_MAX_DISTANCE;
+			break;
+		}
+		x0 = fmin(x0, x);
+		y0 = fmin(y0, y);
+		x1 = fmax(x1, x);
+		y1 = fmax(y1, y);
+	}
+	x0 = fmax(x0, cx - BG_MAX_DISTANCE);
+	y0 = fmax(y0, cy - BG_MAX_DISTANCE);
+	x1 = fmin(x1, cx + BG_MAX_DISTANCE);
+	y1 = fmin(y1, cy + BG_MAX_DISTANCE);
+
+	int tx0 = fmax(floor(x0 / BG_TILE_SIZE), 0), ty0 = fmax(floor(y0 / BG_TILE_SIZE), 0);
+	int tx1 = fmin(floor(x1 / BG_TILE_SIZE), data->w / BG_TILE_SIZE - 1), ty1 = fmin(floor(y1 / BG_TILE_SIZE), data->h / BG_TILE_SIZE - 1);
+
+	ALLEGRO_VERTEX vertices[BG_MAX_TILES * 6];
+	ALLEGRO_COLOR white = al_map_rgb(255, 255, 255);
+	int count = 0;
+	for (int ty = ty0; ty <= ty1; ty++) {
+		for (int tx = tx0; tx <= tx1; tx++) {
+			float left = tx * BG_TILE_SIZE, top = ty * BG_TILE_SIZE;
+			float right = left + BG_TILE_SIZE, bottom = top + BG_TILE_SIZE;
+			ALLEGRO_VERTEX tile[6] = {
+				{.x = left, .y = top, .u = left, .v = top, .color = white},
+				{.x = left, .y = bottom, .u = left, .v = bottom, .color = white},
+				{.x = right, .y = bottom, .u = right, .v = bottom, .color = white},
+				{.x = left, .y = top, .u = left, .v = top, .color = white},
+				{.x = right, .y = top, .u = right, .v = top, .color = white},
+				{.x = right, .y = bottom, .u = right, .v = bottom, .color = white},
+			};
+			memcpy(&vertices[count], tile, sizeof(tile));
+			count += 6;
+		}
+	}
+	if (count) {
+		al_draw_prim(vertices, NULL, data->bg, 0, count, ALLEGRO_PRIM_TRIANGLE_LIST);
+	}
+}
 
-				if (data->entities[i].distance > 200) {
-					data->entities[i].angle = rand() / ALLEGRO_PI;
-					data->entities[i].distance = 0;
+static bool Grow(void** ptr, size_t size) {
+	void* grown = realloc(*ptr, size);
+	if (grown) {
+		*ptr = grown;
+	}
+	return grown;
+}
 
-					if (data->entities[i].type == TYPE_ENEMY) {
-						SpawnEntity(game, data, data->entities[i].x, data->entities[i].y, 0, TYPE_FAKE);
-					} else {
-						if (rand() % 30 > 20) {
-							SpawnEntity(game, data, data->entities[i].x, data->entities[i].y, 0, TYPE_MESSAGE);
-						}
-					}
-				}
-			}
+static double Lerp(double a, double b, double alpha) {
+	return a + (b - a) * alpha;
+}
 
-			if (data->entities[i].type == TYPE_EXPLOSION) {
-				data->entities[i].distance++;
-				if (data->entities[i].distance > 16) {
-					data->entities[i].used = false;
-				}
-			}
+// Projects the whole list, placed `alpha` of the way from the previous tick,
+// into data->projected; returns how many entities can be seen on screen
+// (their indices are in data->projected.visible), or -1 when there's no
+// memory for the buffers, in which case nothing got projected.
+static int ProjectEntities(struct GamestateResources* data, const ALLEGRO_TRANSFORM* projview, const struct SimFrameList* list, double alpha, float margin) {
+	if (list->count > data->projected.capacity) {
+		int capacity = list->capacity;
+		bool ok = Grow((void**)&data->projected.wx, sizeof(double) * capacity);
+		ok = Grow((void**)&data->projected.wy, sizeof(double) * capacity) && ok;
+		ok = Grow((void**)&data->projected.x, sizeof(float) * capacity) && ok;
+		ok = Grow((void**)&data->projected.y, sizeof(float) * capacity) && ok;
+		ok = Grow((void**)&data->projected.z, sizeof(float) * capacity) && ok;
+		ok = Grow((void**)&data->projected.visible, sizeof(int) * capacity) && ok;
+		if (!ok) {
+			return -1;
 		}
+		data->projected.capacity = capacity;
+	}
+	for (int i = 0; i < list->count; i++) {
+		data->projected.wx[i] = Lerp(list->prev_x[i], list->x[i], alpha);
+		data->projected.wy[i] = Lerp(list->prev_y[i], list->y[i], alpha);
 	}
+	return ProjectGroundPoints(projview->m, data->projected.wx, data->projected.wy, list->count, 320, 180, margin,
+		data->projected.x, data->projected.y, data->projected.z, data->projected.visible);
 }
 
 void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 	// Called as soon as possible, but no sooner than next Gamestate_Logic call.
 	// Draw everything to the screen here.
-	//al_draw_scaled_bitmap(data->internet, 0, 0, 4096, 4096, 0, 0, 320, 180, 0);
 
 	if (data->ended) {
 		if (data->endscreen) {
@@ -466,29 +710,38 @@ void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 			al_draw_bitmap(data->endscreen, 0, 0, 0);
 
 			if (data->showscore) {
-				al_draw_textf(data->bff, al_map_rgb(255, 255, 255), 320 / 2, 115, ALLEGRO_ALIGN_CENTER, "%d", data->score);
+				al_draw_textf(data->bff, al_map_rgb(255, 255, 255), 320 / 2, 115, ALLEGRO_ALIGN_CENTER, "%d", TakeSimFrame(data->worker)->score);
 			}
 		}
 		return;
 	}
 
+	const struct SimFrame* frame = TakeSimFrame(data->worker);
+	struct Profiler* prof = game->data->profiler;
 	ALLEGRO_TRANSFORM transform, perspective, camera;
 
+	// Everything is drawn in between the last two ticks, as far as the time
+	// left in the accumulator, so motion stays smooth at any refresh rate.
+	// While the worker is still catching up there's nothing newer to go towards.
+	double alpha = (frame->steps == data->worker->requested) ? data->accumulator / SIM_TICK : 1.0;
+	double px = Lerp(frame->prev_x, frame->x, alpha), py = Lerp(frame->prev_y, frame->y, alpha);
+	double angle = Lerp(frame->prev_angle, frame->angle, alpha);
+
 	al_set_target_bitmap(data->pixelator);
-	al_clear_to_color(al_map_rgb(0 + data->pew * 1.5 + 5 + sin(data->count / 10.0) * 5, 62 + data->pew * 4 + 5 + sin(data->count / 10.0) * 5, 0 + data->pew * 1.5 + 5 + sin(data->count / 10.0) * 5));
+	al_clear_to_color(al_map_rgb(0 + frame->pew * 1.5 + 5 + sin(frame->tick / 10.0) * 5, 62 + frame->pew * 4 + 5 + sin(frame->tick / 10.0) * 5, 0 + frame->pew * 1.5 + 5 + sin(frame->tick / 10.0) * 5));
 
 	al_identity_transform(&camera);
 	al_build_camera_transform(&camera,
 		0, 0, -2, 0, 0, 0, 0, 1, 0);
 
 	al_identity_transform(&transform);
-	al_translate_transform(&transform, -data->x, -data->y);
+	al_translate_transform(&transform, -px, -py);
 	//al_translate_transform(&transform, 0, 180 / 2);
-	al_rotate_transform(&transform, data->angle);
+	al_rotate_transform(&transform, angle);
 	//al_translate_transform(&transform, 0, -180 / 2);
 	al_translate_transform(&transform, 0, -180 / 4);
 	al_rotate_transform_3d(&transform, 1, 0, 0, 0.005);
-	if (data->tilt) {
+	if (frame->tilt) {
 		al_translate_transform(&transform, rand() % 3 - 1, rand() % 3 - 1);
 	}
 	al_compose_transform(&transform, &camera);
@@ -498,23 +751,28 @@ void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 
 	al_use_transform(&transform);
 	al_use_projection_transform(&perspective);
+
+	ALLEGRO_TRANSFORM projview;
+	al_identity_transform(&projview);
+	al_compose_transform(&projview, &transform);
+	al_compose_transform(&projview, &perspective);
+
+	ProfilerBegin(prof, "background");
+	DrawBackground(data, &projview, px, py);
+	ProfilerEnd(prof);
+
+	ProfilerBegin(prof, "entities");
 	float x = data->w / 2, y = data->h / 2, z = 0;
-	al_draw_bitmap(data->internet, 0, 0, 0);
-	for (int i = 0; i < 8192; i++) {
-		if (data->entities[i].used) {
-			if (data->entities[i].type == TYPE_BULLET) {
-				al_draw_filled_rectangle(round(data->entities[i].x) - 2, round(data->entities[i].y) - 2, round(data->entities[i].x) + 2, round(data->entities[i].y) + 2, al_map_rgb(254, 232, 0));
-			}
-		}
+	const struct SimFrameList* bullets = &frame->lists[TYPE_BULLET];
+	for (int i = 0; i < bullets->count; i++) {
+		double bx = round(Lerp(bullets->prev_x[i], bullets->x[i], alpha)), by = round(Lerp(bullets->prev_y[i], bullets->y[i], alpha));
+		BatchQuad(&data->shapes, bx - 2, by - 2, bx + 2, by + 2, 0, 0, 0, 0, al_map_rgb(254, 232, 0));
 	}
+	FlushBatch(&data->shapes, NULL);
 
 	SetFramebufferAsTarget(game);
 	al_draw_bitmap(data->pixelator, 0, 0, 0);
 
-	ALLEGRO_TRANSFORM projview;
-	al_identity_transform(&projview);
-	al_compose_transform(&projview, &transform);
-	al_compose_transform(&projview, &perspective);
 	al_transform_coordinates_3d_projective(&projview, &x, &y, &z);
 
 	//PrintConsole(game, "x %f, y %f, z %f", x, y, z);
@@ -522,146 +780,150 @@ void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 	y = y * -180 / 2 + 180 / 2;
 	//al_draw_filled_rectangle(x - 2, y - 2, x + 2, y + 2, al_map_rgb(0, 0, 255));
 
-	for (int i = 0; i < 8192; i++) {
-		if (data->entities[i].used) {
-			x = data->entities[i].x;
-			y = data->entities[i].y;
-			z = 0;
-			al_transform_coordinates_3d_projective(&projview, &x, &y, &z);
-			x = x * 320 / 2 + 320 / 2;
-			y = y * -180 / 2 + 180 / 2;
-
-			if (data->entities[i].type == TYPE_FAKE) {
-				DrawCentered(data->fake->frame->bitmap, x, y, 0);
-			}
-			if (data->entities[i].type == TYPE_MESSAGE) {
-				DrawCentered(data->news->frame->bitmap, x, y, 0);
+	struct Character* characters[TYPE_COUNT] = {
+		[TYPE_ENEMY] = data->bad,
+		[TYPE_USER] = data->user,
+		[TYPE_MESSAGE] = data->news,
+		[TYPE_FAKE] = data->fake,
+		[TYPE_EXPLOSION] = data->explosion,
+	};
+
+	// sprites and markers go in one batch each, explosion scores are drawn on top afterwards
+	for (enum ENTITY_TYPE type = 0; type < TYPE_COUNT; type++) {
+		if (!characters[type]) {
+			continue;
+		}
+		struct AtlasRegion region;
+		bool batched = GetAtlasRegion(data->atlas, characters[type], &region);
+		float margin = batched ? fmax(region.w, region.h) / 2 + 1 : 32;
+		const struct SimFrameList* list = &frame->lists[type];
+		int visible = ProjectEntities(data, &projview, list, alpha, margin);
+
+		for (int i = 0; i < visible; i++) {
+			int j = data->projected.visible[i];
+			if (batched) {
+				BatchRegion(&data->sprites, &region, data->projected.x[j], data->projected.y[j]);
+			} else {
+				DrawCentered(characters[type]->frame->bitmap, data->projected.x[j], data->projected.y[j], 0);
 			}
-			if (data->entities[i].type == TYPE_USER) {
-				DrawCentered(data->user->frame->bitmap, x, y, 0);
+		}
+
+		if (((type != TYPE_ENEMY) && (type != TYPE_FAKE)) || (visible < 0)) {
+			continue;
+		}
+		for (int i = 0; i < list->count; i++) {
+			x = data->projected.x[i];
+			y = data->projected.y[i];
+			if (data->projected.z[i] <= 0) {
+				continue;
 			}
-			if (data->entities[i].type == TYPE_ENEMY) {
-				DrawCentered(data->bad->frame->bitmap, x, y, 0);
+			//PrintConsole(game, "%f %f %f", x, y, z);
+			int w = 8, h = 8;
+			bool marker = false;
+			if (x < 0) {
+				x = 0;
+				w = 2;
+				marker = true;
+			} else if (x > 320) {
+				x = 318;
+				w = 2;
+				marker = true;
 			}
-			if (data->entities[i].type == TYPE_EXPLOSION) {
-				DrawCentered(data->explosion->frame->bitmap, x, y, 0);
-				al_draw_textf(data->font, al_map_rgb(0, 0, 0), x + 1 + 3, y - 5 + 1, ALLEGRO_ALIGN_CENTER, "%d", data->entities[i].score);
-				al_draw_textf(data->font, al_map_rgb(255, 255, 255), x + 3, y - 5, ALLEGRO_ALIGN_CENTER, "%d", data->entities[i].score);
+			if (y < 0) {
+				y = 0;
+				h = 2;
+				marker = true;
+			} else if (y > 180) {
+				y = 178;
+				h = 2;
+				marker = true;
 			}
 
-			if (((data->entities[i].type == TYPE_ENEMY) || (data->entities[i].type == TYPE_FAKE)) && (z > 0)) {
-				//PrintConsole(game, "%f %f %f", x, y, z);
-				int w = 8, h = 8;
-				bool marker = false;
-				if (x < 0) {
-					x = 0;
-					w = 2;
-					marker = true;
-				} else if (x > 320) {
-					x = 318;
-					w = 2;
-					marker = true;
-				}
-				if (y < 0) {
-					y = 0;
-					h = 2;
-					marker = true;
-				} else if (y > 180) {
-					y = 178;
-					h = 2;
-					marker = true;
-				}
-
-				if (marker) {
-					al_draw_filled_rectangle(x, y, x + w, y + h, al_map_rgb(255, 0, 0));
-				}
+			if (marker) {
+				BatchQuad(&data->shapes, x, y, x + w, y + h, 0, 0, 0, 0, al_map_rgb(255, 0, 0));
 			}
 		}
 	}
+	FlushBatch(&data->sprites, data->atlas->bitmap);
+	FlushBatch(&data->shapes, NULL);
+
+	const struct SimFrameList* explosions = &frame->lists[TYPE_EXPLOSION];
+	int visible = ProjectEntities(data, &projview, explosions, alpha, 32);
+	for (int i = 0; i < visible; i++) {
+		int j = data->projected.visible[i];
+		x = data->projected.x[j];
+		y = data->projected.y[j];
+		BatchNumber(data->numbers, &data->digits, x + 1 + 3, y - 5 + 1, ALLEGRO_ALIGN_CENTER, explosions->score[j], al_map_rgb(0, 0, 0));
+		BatchNumber(data->numbers, &data->digits, x + 3, y - 5, ALLEGRO_ALIGN_CENTER, explosions->score[j], al_map_rgb(255, 255, 255));
+	}
+	FlushBatch(&data->digits, data->numbers->bitmap);
+	ProfilerEnd(prof);
 
+	ProfilerBegin(prof, "hud");
 	SetCharacterPosition(game, data->car, 320 / 2 - 23, 3 * 180 / 4, 0);
 	DrawCharacter(game, data->car);
 
 	SetCharacterPosition(game, data->police, 320 / 2 - 23 + 13, 3 * 180 / 4 + 4, 0);
 	DrawCharacter(game, data->police);
 
-	al_draw_textf(data->font, al_map_rgb(0, 0, 0), 3 + 1, 180 - 11 + 1, ALLEGRO_ALIGN_LEFT, "%d", data->score);
-	al_draw_textf(data->font, al_map_rgb(255, 255, 255), 3, 180 - 11, ALLEGRO_ALIGN_LEFT, "%d", data->score);
+	BatchNumber(data->numbers, &data->digits, 3 + 1, 180 - 11 + 1, ALLEGRO_ALIGN_LEFT, frame->score, al_map_rgb(0, 0, 0));
+	BatchNumber(data->numbers, &data->digits, 3, 180 - 11, ALLEGRO_ALIGN_LEFT, frame->score, al_map_rgb(255, 255, 255));
+	FlushBatch(&data->digits, data->numbers->bitmap);
 
 	SetCharacterPosition(game, data->teeth, 209, 164, 0);
 	DrawCharacter(game, data->teeth);
 
 	al_draw_filled_rectangle(228, 167, 316, 176, al_premul_rgba_f(0, 0, 0, 0.8));
-	al_draw_filled_rectangle(229, 168, 229 + (315 - 229) * (data->fake_counter / 64.0), 175, al_premul_rgba_f(1, 1, 1, 1));
+	al_draw_filled_rectangle(229, 168, 229 + (315 - 229) * (frame->fake_counter / (double)SIM_MAX_FAKES), 175, al_premul_rgba_f(1, 1, 1, 1));
 
-	al_draw_filled_rectangle(0, 0, 320, 180, al_premul_rgba(0, 0, 0, 255 - data->fade));
+	al_draw_filled_rectangle(0, 0, 320, 180, al_premul_rgba(0, 0, 0, 255 - frame->fade));
 
-	if (game->data->text) {
-		al_draw_filled_rectangle(0, 0, 320, 53, al_map_rgba(0, 0, 0, 128));
-		al_draw_text(data->font, al_map_rgb(255, 255, 255), 3, 3, ALLEGRO_ALIGN_LEFT, game->data->person);
-		DrawWrappedText(data->font, al_map_rgb(255, 255, 255), 3, 3 + 10, 320 - 6, ALLEGRO_ALIGN_LEFT, game->data->text);
-	}
+	DrawSubtitle(game);
 
 	if (data->showlogo) {
-		al_draw_bitmap(data->logo, 0, (int)(sin(data->count / 10.0) * 6) + 3, 0);
+		al_draw_bitmap(data->logo, 0, (int)(sin(frame->tick / 10.0) * 6) + 3, 0);
 	}
+	ProfilerEnd(prof);
 }
 
 void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data, ALLEGRO_EVENT* ev) {
 	// Called for each event in Allegro event queue.
 	// Here you can handle user input, expiring timers etc.
-	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_ESCAPE)) {
-		UnloadCurrentGamestate(game); // mark this gamestate to be stopped and unloaded
-		// When there are no active gamestates, the engine will quit.
-	}
-
-	// TODO: add as a helper function to the engine
-	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_LEFT)) {
-		data->left = true;
-	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_UP) && (ev->keyboard.keycode == ALLEGRO_KEY_LEFT)) {
-		data->left = false;
-	}
-
-	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_RIGHT)) {
-		data->right = true;
-	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_UP) && (ev->keyboard.keycode == ALLEGRO_KEY_RIGHT)) {
-		data->right = false;
-	}
-
-	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_UP)) {
-		data->up = true;
-	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_UP) && (ev->keyboard.keycode == ALLEGRO_KEY_UP)) {
-		data->up = false;
+	static const struct {
+		int keycode;
+		enum REPLAY_KEY key;
+	} keys[] = {
+		{ALLEGRO_KEY_LEFT, REPLAY_KEY_LEFT},
+		{ALLEGRO_KEY_RIGHT, REPLAY_KEY_RIGHT},
+		{ALLEGRO_KEY_UP, REPLAY_KEY_UP},
+		{ALLEGRO_KEY_DOWN, REPLAY_KEY_DOWN},
+		{ALLEGRO_KEY_SPACE, REPLAY_KEY_SPACE},
+		{ALLEGRO_KEY_FULLSTOP, REPLAY_KEY_FULLSTOP},
+		{ALLEGRO_KEY_ESCAPE, REPLAY_KEY_ESCAPE},
+	};
+	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) || (ev->type == ALLEGRO_EVENT_KEY_UP)) {
+		for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+			// while replaying, only escape is still up to the player
+			if ((ev->keyboard.keycode == keys[i].keycode) && (!data->replay || (keys[i].key == REPLAY_KEY_ESCAPE))) {
+				HandleKey(game, data, keys[i].key, ev->type == ALLEGRO_EVENT_KEY_DOWN);
+			}
+		}
 	}
 
-	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_DOWN)) {
-		data->down = true;
-	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_UP) && (ev->keyboard.keycode == ALLEGRO_KEY_DOWN)) {
-		data->down = false;
+	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_F5) && !data->ended) {
+		QuickSave(game, data);
 	}
 
-	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_FULLSTOP)) {
-		game->data->skip = true;
+	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_F6)) {
+		SaveRecording(game, data);
 	}
 
-	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_SPACE)) {
-		SelectSpritesheet(game, data->police, "ban");
-
-		SpawnEntity(game, data, data->x + sin(data->angle + ALLEGRO_PI / 2) * 10, data->y + cos(data->angle + ALLEGRO_PI / 2) * 10, data->angle, TYPE_BULLET);
-
-		int s = rand() % 10;
-		al_stop_sample_instance(data->bullets[s].sound);
-		al_play_sample_instance(data->bullets[s].sound);
-
-		data->pew = 10;
+	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_F9)) {
+		QuickLoad(game, data);
 	}
 
-	if ((ev->type == ALLEGRO_EVENT_KEY_UP) && (ev->keyboard.keycode == ALLEGRO_KEY_SPACE)) {
-		SelectSpritesheet(game, data->police, "normal");
+	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_ENTER) && data->ended) {
+		RestoreGame(game, data, data->retry, data->retry_size);
 	}
 }
 
@@ -673,29 +935,49 @@ void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 	// Unless you're sure what you're doing, avoid using drawing calls and other things that
 	// require main OpenGL context.
 
+	UseAssetPack();
 	struct GamestateResources* data = calloc(1, sizeof(struct GamestateResources));
 
-	data->w = 8192;
-	data->h = 8192;
-	data->internet = al_create_bitmap(data->w, data->h);
-	progress(game); // report that we progressed with the loading, so the engine can move a progress bar
+	data->w = SIM_WORLD_SIZE;
+	data->h = SIM_WORLD_SIZE;
 
-	data->bg = al_load_bitmap(GetDataFilePath(game, "bg.png"));
-	progress(game);
-	data->timeline = TM_Init(game, data, "timeline");
+	// Images, fonts and sound effects get decoded on worker threads, while
+	// this thread takes care of characters (libsuperderpy's spritesheet loader
+	// isn't safe to run concurrently) and everything else. Every queued asset
+	// counts as one progress step once it's done.
+	struct LoadPool* pool = CreateLoadPool(game, progress);
+	char* pcm_path = FindDataFilePath(game, "samples.pcm");
+	data->pcm = OpenPCMCache(pcm_path);
+	free(pcm_path);
+	LoadBitmapAsync(pool, &data->bg, GetDataFilePath(game, "bg.png"));
 
 	int flags = al_get_new_bitmap_flags();
 	al_set_new_bitmap_flags(flags ^ ALLEGRO_MAG_LINEAR);
+	LoadBitmapAsync(pool, &data->logo, GetDataFilePath(game, "logo.png"));
+	LoadBitmapAsync(pool, &data->endscreen1, GetDataFilePath(game, "outro1.png"));
+	LoadBitmapAsync(pool, &data->endscreen2, GetDataFilePath(game, "outro2.png"));
+	LoadBitmapAsync(pool, &data->endscreen3, GetDataFilePath(game, "outro3.png"));
+	LoadFontAsync(pool, &data->font, GetDataFilePath(game, "fonts/MonkeyIsland.ttf"), 8, ALLEGRO_TTF_MONOCHROME);
+	LoadFontAsync(pool, &data->bff, GetDataFilePath(game, "fonts/MonkeyIsland.ttf"), 32, ALLEGRO_TTF_MONOCHROME);
+
+	for (int i = 0; i < 10; i++) {
+		char filename[255];
+		snprintf(filename, 255, "bullet/%d.flac", i + 1);
+		LoadSampleAsync(pool, &data->bullets[i], data->pcm, filename, GetDataFilePath(game, filename));
+	}
+
+	for (int i = 0; i < 8; i++) {
+		char filename[255];
+		snprintf(filename, 255, "explosions/%d.flac", i + 1);
+		LoadSampleAsync(pool, &data->explosions[i], data->pcm, filename, GetDataFilePath(game, filename));
+	}
+
+	data->timeline = TM_Init(game, data, "timeline");
+	data->intro = LoadCutscene(game, "intro");
+	data->outro = LoadCutscene(game, "outro");
+	data->voices = CreateVoicePool(game, 3);
 	data->pixelator = CreateNotPreservedBitmap(320, 180);
-	progress(game);
-	data->logo = al_load_bitmap(GetDataFilePath(game, "logo.png"));
-	progress(game);
-	data->endscreen1 = al_load_bitmap(GetDataFilePath(game, "outro1.png"));
-	progress(game);
-	data->endscreen2 = al_load_bitmap(GetDataFilePath(game, "outro2.png"));
-	progress(game);
-	data->endscreen3 = al_load_bitmap(GetDataFilePath(game, "outro3.png"));
-	progress(game);
+	progress(game); // report that we progressed with the loading, so the engine can move a progress bar
 
 	data->music1 = al_load_audio_stream(GetDataFilePath(game, "song1.flac"), 4, 1024);
 	al_set_audio_stream_playing(data->music1, false);
@@ -712,64 +994,55 @@ void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 	RegisterSpritesheet(game, data->car, "car");
 	LoadSpritesheets(game, data->car, progress);
 	progress(game);
+	PumpLoadPool(pool);
 	data->police = CreateCharacter(game, "police");
 	RegisterSpritesheet(game, data->police, "normal");
 	RegisterSpritesheet(game, data->police, "ban");
 	LoadSpritesheets(game, data->police, progress);
 	progress(game);
+	PumpLoadPool(pool);
 	data->teeth = CreateCharacter(game, "teeth");
 	RegisterSpritesheet(game, data->teeth, "teeth");
 	LoadSpritesheets(game, data->teeth, progress);
 	progress(game);
+	PumpLoadPool(pool);
 	data->user = CreateCharacter(game, "user");
 	RegisterSpritesheet(game, data->user, "user");
 	LoadSpritesheets(game, data->user, progress);
 	progress(game);
+	PumpLoadPool(pool);
 	data->fake = CreateCharacter(game, "fake");
 	RegisterSpritesheet(game, data->fake, "fake");
 	LoadSpritesheets(game, data->fake, progress);
 	progress(game);
+	PumpLoadPool(pool);
 	data->news = CreateCharacter(game, "news");
 	RegisterSpritesheet(game, data->news, "news");
 	LoadSpritesheets(game, data->news, progress);
 	progress(game);
+	PumpLoadPool(pool);
 	data->bad = CreateCharacter(game, "bad");
 	RegisterSpritesheet(game, data->bad, "bad");
 	LoadSpritesheets(game, data->bad, progress);
 	progress(game);
+	PumpLoadPool(pool);
 	data->explosion = CreateCharacter(game, "explosion");
 	RegisterSpritesheet(game, data->explosion, "explosion");
 	LoadSpritesheets(game, data->explosion, progress);
 	progress(game);
-	data->font = al_load_font(GetDataFilePath(game, "fonts/MonkeyIsland.ttf"), 8, ALLEGRO_TTF_MONOCHROME);
-	progress(game);
-	data->bff = al_load_font(GetDataFilePath(game, "fonts/MonkeyIsland.ttf"), 32, ALLEGRO_TTF_MONOCHROME);
-	progress(game);
-	al_set_new_bitmap_flags(flags);
+	data->atlas = CreateAtlas(game, (struct Character*[]){data->user, data->fake, data->news, data->bad, data->explosion}, 5);
 
-	for (int i = 0; i < 10; i++) {
-		char* filename = malloc(255 * sizeof(char));
-		snprintf(filename, 255, "bullet/%d.flac", i + 1);
+	FinishLoadPool(pool);
 
-		data->bullets[i].sample = al_load_sample(GetDataFilePath(game, filename));
-		data->bullets[i].sound = al_create_sample_instance(data->bullets[i].sample);
-		al_attach_sample_instance_to_mixer(data->bullets[i].sound, game->audio.fx);
-		al_set_sample_instance_playmode(data->bullets[i].sound, ALLEGRO_PLAYMODE_ONCE);
-		free(filename);
-		progress(game);
-	}
+	// the digits get drawn at fractional positions, so they need to stay crisp too
+	data->numbers = CreateNumberFont(game, data->font);
+	al_set_new_bitmap_flags(flags);
 
-	for (int i = 0; i < 8; i++) {
-		char* filename = malloc(255 * sizeof(char));
-		snprintf(filename, 255, "explosions/%d.flac", i + 1);
+	// enough voices to keep a few explosions going under constant fire
+	data->sfx = CreateSfxPool(game->audio.fx, 12, 4);
 
-		data->explosions[i].sample = al_load_sample(GetDataFilePath(game, filename));
-		data->explosions[i].sound = al_create_sample_instance(data->explosions[i].sample);
-		al_attach_sample_instance_to_mixer(data->explosions[i].sound, game->audio.fx);
-		al_set_sample_instance_playmode(data->explosions[i].sound, ALLEGRO_PLAYMODE_ONCE);
-		free(filename);
-		progress(game);
-	}
+	// one core for the main thread and one for the sim worker, which runs jobs too
+	data->jobs = CreateJobPool(al_get_cpu_count() - 2);
 
 	return data;
 }
@@ -778,7 +1051,6 @@ void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
 	// Called when the gamestate library is being unloaded.
 	// Good place for freeing all allocated memory and resources.
 
-	al_destroy_bitmap(data->internet);
 	al_destroy_bitmap(data->pixelator);
 	al_destroy_bitmap(data->bg);
 	al_destroy_bitmap(data->logo);
@@ -793,7 +1065,21 @@ void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
 	DestroyCharacter(game, data->news);
 	DestroyCharacter(game, data->bad);
 	DestroyCharacter(game, data->explosion);
+	DestroyAtlas(data->atlas);
+	DestroyBatch(&data->sprites);
+	DestroyBatch(&data->shapes);
+	DestroyBatch(&data->digits);
+	DestroyNumberFont(data->numbers);
+	free(data->projected.wx);
+	free(data->projected.wy);
+	free(data->projected.x);
+	free(data->projected.y);
+	free(data->projected.z);
+	free(data->projected.visible);
 	TM_Destroy(data->timeline);
+	DestroyScript(data->intro);
+	DestroyScript(data->outro);
+	DestroyVoicePool(data->voices);
 	al_destroy_font(data->font);
 	al_destroy_font(data->bff);
 
@@ -801,14 +1087,15 @@ void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
 
 	al_destroy_audio_stream(data->music2);
 
+	DestroySfxPool(data->sfx);
 	for (int i = 0; i < 10; i++) {
-		al_destroy_sample_instance(data->bullets[i].sound);
-		al_destroy_sample(data->bullets[i].sample);
+		al_destroy_sample(data->bullets[i]);
 	}
 	for (int i = 0; i < 8; i++) {
-		al_destroy_sample_instance(data->explosions[i].sound);
-		al_destroy_sample(data->explosions[i].sample);
+		al_destroy_sample(data->explosions[i]);
 	}
+	ClosePCMCache(data->pcm);
+	DestroyJobPool(data->jobs);
 	free(data);
 }
 
@@ -819,7 +1106,31 @@ void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
 	al_set_mixer_gain(game->audio.music, 0.25);
 	al_set_mixer_gain(game->audio.fx, 1.0);
 	al_set_mixer_gain(game->audio.voice, 2.0);
-	data->fake_counter = 2;
+
+	// replays (for testing) are set in the config file, as [ZenekGienek] replay=path
+	uint64_t seed = rand();
+	const char* replay = GetConfigOption(game, "ZenekGienek", "replay");
+	if (replay) {
+		data->replay = LoadReplay(replay);
+		if (data->replay) {
+			seed = data->replay->seed;
+			PrintConsole(game, "Playing replay %s", replay);
+		} else {
+			PrintConsole(game, "Could not load replay %s!", replay);
+		}
+	}
+	data->record = data->replay ? NULL : CreateReplay(seed);
+
+	struct Sim* sim = CreateSim(seed);
+	SetSimJobs(sim, data->jobs);
+	if (data->replay) {
+		sim->endless = data->replay->endless;
+	}
+	data->worker = CreateSimWorker(sim);
+	data->heard_explosions = 0;
+	data->sim_failed = false;
+	data->accumulator = 0;
+	data->input = 0;
 
 	SelectSpritesheet(game, data->car, "car");
 	SelectSpritesheet(game, data->police, "normal");
@@ -830,109 +1141,27 @@ void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
 	SelectSpritesheet(game, data->bad, "bad");
 	SelectSpritesheet(game, data->explosion, "explosion");
 
-	data->angle = ALLEGRO_PI;
-
-	al_set_target_bitmap(data->internet);
-	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
-
-	ALLEGRO_VERTEX vertices[6] = {
-		// bottom left triangle
-		{.x = 0, .y = 0, .u = 0, .v = 0, .color = al_map_rgb(255, 255, 255)}, // top left
-		{.x = 0, .y = data->h, .u = 0, .v = data->h, .color = al_map_rgb(255, 255, 255)}, // bottom left
-		{.x = data->w, .y = data->h, .u = data->w, .v = data->h, .color = al_map_rgb(255, 255, 255)}, // bottom right
-		// up right triangle
-		{.x = 0, .y = 0, .u = 0, .v = 0, .color = al_map_rgb(255, 255, 255)}, // top left
-		{.x = data->w, .y = 0, .u = data->w, .v = 0, .color = al_map_rgb(255, 255, 255)}, // top right
-		{.x = data->w, .y = data->h, .u = data->w, .v = data->h, .color = al_map_rgb(255, 255, 255)}, // bottom right
-	};
-
-	al_draw_prim(vertices, NULL, data->bg, 0, 6, ALLEGRO_PRIM_TRIANGLE_LIST);
-
-	//al_draw_filled_rectangle(data->w / 2 - 5, data->h / 2 - 5, data->w / 2 + 5, data->h / 2 + 5, al_map_rgb(255, 0, 0));
-
 	SetFramebufferAsTarget(game);
 
-	data->x = data->w / 2;
-	data->y = 3 * data->h / 4;
-
-	TM_AddDelay(data->timeline, 1.5);
-
-	TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/zenek.flac"), 4, 1024), "To co dzisiaj robimy, Gienek?", "ZENEK"));
-	TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/gienek.flac"), 4, 1024), "No jak to co Zenek, przejmujemy wladze nad swiatem!", "GIENEK"));
-	TM_AddAction(data->timeline, &ShowLogo, NULL);
-	TM_AddDelay(data->timeline, 5);
-	TM_AddAction(data->timeline, &HideLogo, NULL);
-	TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/intro1.flac"), 4, 1024), "*dryn dryn*", "TELEFON"));
-	TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/intro2.flac"), 4, 1024), "Halo, policja? Prosze przyjechac na Fejsbuga™!", "GLOS Z TELEFONU"));
-	TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/intro3.flac"), 4, 1024), "Sie robi.", "KOMISARZ ZIEBA"));
-	TM_AddAction(data->timeline, &StartGame, NULL);
-
-	TM_AddDelay(data->timeline, 2);
-
-	TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/1.flac"), 4, 1024), "Nazywam sie Zieba. Komisarz Zieba.", "KOMISARZ ZIEBA"));
-
-	TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/2.flac"), 4, 1024), "Dbam o porzadek na Fejsbugu™, by nikt nie przeszkadzal uzytkownikom wiesc ich spokojnego uzytkowniczego zycia.", "KOMISARZ ZIEBA"));
-
-	TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/3.flac"), 4, 1024), "Poruszam sie moim cybernetycznym poduszkowcem po cyberprzestrzeni za pomoca KLAWISZY STRZALEK", "KOMISARZ ZIEBA"));
-	TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/4.flac"), 4, 1024), "a wymierzam sprawiedliwosc moim wiernym Banhammerem za pomoca SPACJI.", "KOMISARZ ZIEBA"));
-
-	TM_AddDelay(data->timeline, 1);
-
-	TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/5.flac"), 4, 1024), "Swietnie.", "KOMISARZ ZIEBA"));
-
-	TM_AddDelay(data->timeline, 1);
-
-	TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/6.flac"), 4, 1024), "Znowu ktos wypuszcza Fake Newsy.", "KOMISARZ ZIEBA"));
-
-	TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/7.flac"), 4, 1024), "Musze je unicestwic zanim uzytkownicy znajda sie pod ich wplywem.", "KOMISARZ ZIEBA"));
-
-	TM_AddAction(data->timeline, &SpawnSingleFake, NULL);
-
-	TM_AddDelay(data->timeline, 4);
-
-	TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/8.flac"), 4, 1024), "I po sprawie.", "KOMISARZ ZIEBA"));
-
-	TM_AddDelay(data->timeline, 2);
-
-	TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/9.flac"), 4, 1024), "Oto i jest. Manipulator.", "KOMISARZ ZIEBA"));
-
-	TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/10.flac"), 4, 1024), "Nastawia ludzi przeciwko sobie, aby byli podatni na manipulacje, zeby ich zmanipulowac.", "KOMISARZ ZIEBA"));
-
-	TM_AddAction(data->timeline, &SpawnSingleEnemy, NULL);
-
-	TM_AddDelay(data->timeline, 4);
-
-	TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/12.flac"), 4, 1024), "Jest ich wiecej.", "KOMISARZ ZIEBA"));
-
-	TM_AddAction(data->timeline, &SpawnEnemies, NULL);
-
-	TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/ostroznie2.flac"), 4, 1024), "Nie moge banowac zwyklych uzytkownikow i ich zwyklych tresci, bo zaczna sie buntowac.", "KOMISARZ ZIEBA"));
-
-	TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/13.flac"), 4, 1024), "Gdy uzytkownicy przekrocza Pulap Spolecznego Zgrzytania Zebami Przeciwko Sobie, zamkna sie w swoich bankach informacyjnych i beda pod pelna kontrola zloczynców.", "KOMISARZ ZIEBA"));
-
-	TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/14.flac"), 4, 1024), "Nie moge do tego dopuscic.", "KOMISARZ ZIEBA"));
-
-	TM_AddAction(data->timeline, &PlayGameMusic, NULL);
-
-	TM_AddDelay(data->timeline, 20);
-
-	TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/16.flac"), 4, 1024), "Zle sily rosna w sile. Usiluja ze mna wygrac, ale jestem silniejszy.", "KOMISARZ ZIEBA"));
-
-	TM_AddDelay(data->timeline, 30);
-
-	TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/17.flac"), 4, 1024), "Jedziemy dalej.", "KOMISARZ ZIEBA"));
-
-	TM_AddDelay(data->timeline, 30);
-
-	TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/15.flac"), 4, 1024), "Kolejna fala. Tym razem bedzie trudniej.", "KOMISARZ ZIEBA"));
-
-	TM_AddDelay(data->timeline, 15);
-
-	TM_AddAction(data->timeline, &Speak, TM_AddToArgs(NULL, 3, al_load_audio_stream(GetDataFilePath(game, "voices/bannivederci.flac"), 4, 1024), "Bannivederci!", "KOMISARZ ZIEBA"));
+	RunScript(game, data, data->intro, 0);
 }
 
 void Gamestate_Stop(struct Game* game, struct GamestateResources* data) {
 	// Called when gamestate gets stopped. Stop timers, music etc. here.
+	StopAllSfx(data->sfx);
+	DestroySimWorker(data->worker);
+	data->worker = NULL;
+	free(data->retry);
+	data->retry = NULL;
+	data->retry_size = 0;
+	if (data->record) {
+		DestroyReplay(data->record);
+		data->record = NULL;
+	}
+	if (data->replay) {
+		DestroyReplay(data->replay);
+		data->replay = NULL;
+	}
 }
 
 void Gamestate_Pause(struct Game* game, struct GamestateResources* data) {
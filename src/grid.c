@@ -0,0 +1,100 @@
+/*! \file grid.c
+ *  \brief Uniform grid for broad phase collision detection.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "grid.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static inline int CellCoord(double pos, double cell_size, int count) {
+	if (pos < 0) {
+		return 0;
+	}
+	double cell = pos / cell_size;
+	if (cell >= count) {
+		return count - 1;
+	}
+	return (int)cell;
+}
+
+struct Grid* CreateGrid(double width, double height, double cell_size, int capacity) {
+	struct Grid* grid = calloc(1, sizeof(struct Grid));
+	grid->cell_size = cell_size;
+	grid->cols = (int)ceil(width / cell_size);
+	grid->rows = (int)ceil(height / cell_size);
+	grid->capacity = capacity;
+	grid->cells = malloc(sizeof(int) * grid->cols * grid->rows);
+	grid->next = malloc(sizeof(int) * capacity);
+	ClearGrid(grid);
+	return grid;
+}
+
+void DestroyGrid(struct Grid* grid) {
+	free(grid->cells);
+	free(grid->next);
+	free(grid);
+}
+
+bool ResizeGrid(struct Grid* grid, int capacity) {
+	int* next = realloc(grid->next, sizeof(int) * capacity);
+	if (!next) {
+		return false;
+	}
+	grid->next = next;
+	grid->capacity = capacity;
+	return true;
+}
+
+void ClearGrid(struct Grid* grid) {
+	memset(grid->cells, 0xff, sizeof(int) * grid->cols * grid->rows);
+}
+
+void GridInsert(struct Grid* grid, int id, double x, double y) {
+	int cell = CellCoord(y, grid->cell_size, grid->rows) * grid->cols + CellCoord(x, grid->cell_size, grid->cols);
+	grid->next[id] = grid->cells[cell];
+	grid->cells[cell] = id;
+}
+
+void GridQueryBegin(const struct Grid* grid, struct GridIterator* it, double x0, double y0, double x1, double y1) {
+	it->grid = grid;
+	it->cx0 = CellCoord(x0, grid->cell_size, grid->cols);
+	it->cx1 = CellCoord(x1, grid->cell_size, grid->cols);
+	it->cy1 = CellCoord(y1, grid->cell_size, grid->rows);
+	it->cx = it->cx0;
+	it->cy = CellCoord(y0, grid->cell_size, grid->rows);
+	it->id = grid->cells[it->cy * grid->cols + it->cx];
+}
+
+int GridQueryNext(struct GridIterator* it) {
+	while (it->id < 0) {
+		it->cx++;
+		if (it->cx > it->cx1) {
+			it->cx = it->cx0;
+			it->cy++;
+			if (it->cy > it->cy1) {
+				return -1;
+			}
+		}
+		it->id = it->grid->cells[it->cy * it->grid->cols + it->cx];
+	}
+	int id = it->id;
+	it->id = it->grid->next[id];
+	return id;
+}
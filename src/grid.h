@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZENEKGIENEK_GRID_H
+#define ZENEKGIENEK_GRID_H
+
+#include <stdbool.h>
+
+// Uniform bucket grid used as a broad phase for entity collisions.
+// Buckets are singly linked lists of integer ids threaded through `next`,
+// so rebuilding the grid costs one memset plus one store per inserted id.
+// Positions outside of the world are clamped into the border cells.
+struct Grid {
+	int cols, rows;
+	double cell_size;
+	int* cells; // head id of each bucket, -1 when empty
+	int* next; // next id in the same bucket, indexed by id
+	int capacity;
+};
+
+struct GridIterator {
+	const struct Grid* grid;
+	int cx0, cx1, cy1;
+	int cx, cy;
+	int id;
+};
+
+struct Grid* CreateGrid(double width, double height, double cell_size, int capacity);
+void DestroyGrid(struct Grid* grid);
+// Leaves the grid as it was when out of memory.
+bool ResizeGrid(struct Grid* grid, int capacity);
+void ClearGrid(struct Grid* grid);
+void GridInsert(struct Grid* grid, int id, double x, double y);
+
+// Iterates over ids stored in all buckets overlapping given box.
+// Returned ids are only candidates - callers still need to do the exact test.
+void GridQueryBegin(const struct Grid* grid, struct GridIterator* it, double x0, double y0, double x1, double y1);
+int GridQueryNext(struct GridIterator* it);
+
+#endif
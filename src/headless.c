@@ -0,0 +1,342 @@
+/*! \file headless.c
+ *  \brief Runs the gameplay simulation without display, audio or GPU.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay.h"
+#include "sim.h"
+#include "snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct Options {
+	int ticks;
+	uint64_t seed;
+	const char* script;
+	const char *load, *save;
+	const char *record, *replay;
+	int threads;
+	bool endless;
+};
+
+static double Now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void Usage(const char* name) {
+	fprintf(stderr, "Usage: %s [--ticks N] [--seed N] [--script FILE] [--load FILE] [--save FILE]\n", name);
+	fprintf(stderr, "       [--record FILE] [--replay FILE] [--threads N] [--endless]\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Without a script, the game is started with a full wave of enemies and\n");
+	fprintf(stderr, "the player steers and shoots at random (derived from the seed).\n");
+	fprintf(stderr, "Script lines have the form \"<tick> <command> [arg]\", where command is one of:\n");
+	fprintf(stderr, "  input <mask>  held keys: 1 left, 2 right, 4 up, 8 down\n");
+	fprintf(stderr, "  fire, start, wave, fake, enemy\n");
+	fprintf(stderr, "--load starts from a snapshot (saved with F5 in game, or with --save) instead of\n");
+	fprintf(stderr, "the title screen; script ticks are then counted from the snapshot's tick.\n");
+	fprintf(stderr, "--save writes a snapshot of the final state.\n");
+	fprintf(stderr, "--record writes everything given to the sim into a replay file.\n");
+	fprintf(stderr, "--replay plays a replay recorded in game (F6) or with --record, using its\n");
+	fprintf(stderr, "seed, --endless and, unless --ticks is given, its length.\n");
+	fprintf(stderr, "--threads runs the heavy phases on N extra job threads; results stay the same.\n");
+	fprintf(stderr, "--endless keeps the game going past the fake news limit.\n");
+}
+
+struct ScriptLine {
+	int tick;
+	enum SIM_COMMAND_TYPE type;
+	int arg;
+};
+
+static bool LoadScript(const char* filename, struct ScriptLine** lines, int* count) {
+	FILE* file = fopen(filename, "r");
+	if (!file) {
+		perror(filename);
+		return false;
+	}
+	int capacity = 0;
+	*lines = NULL;
+	*count = 0;
+
+	static const struct {
+		const char* name;
+		enum SIM_COMMAND_TYPE type;
+	} names[] = {
+		{"input", SIM_COMMAND_INPUT},
+		{"fire", SIM_COMMAND_FIRE},
+		{"start", SIM_COMMAND_START},
+		{"wave", SIM_COMMAND_SPAWN_WAVE},
+		{"fake", SIM_COMMAND_SPAWN_FAKE},
+		{"enemy", SIM_COMMAND_SPAWN_ENEMY},
+	};
+
+	char buf[256];
+	int n = 0;
+	while (fgets(buf, sizeof(buf), file)) {
+		n++;
+		char command[32];
+		int tick, arg = 0;
+		if ((buf[0] == '#') || (buf[0] == '\n')) {
+			continue;
+		}
+		if (sscanf(buf, "%d %31s %d", &tick, command, &arg) < 2) {
+			fprintf(stderr, "%s:%d: can't parse line\n", filename, n);
+			continue;
+		}
+		bool found = false;
+		for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+			if (strcmp(command, names[i].name) == 0) {
+				if (*count == capacity) {
+					int grown = capacity ? capacity * 2 : 64;
+					struct ScriptLine* resized = realloc(*lines, sizeof(struct ScriptLine) * grown);
+					if (!resized) {
+						fprintf(stderr, "%s:%d: out of memory\n", filename, n);
+						free(*lines);
+						*lines = NULL;
+						fclose(file);
+						return false;
+					}
+					*lines = resized;
+					capacity = grown;
+				}
+				(*lines)[(*count)++] = (struct ScriptLine){.tick = tick, .type = names[i].type, .arg = arg};
+				found = true;
+				break;
+			}
+		}
+		if (!found) {
+			fprintf(stderr, "%s:%d: unknown command \"%s\"\n", filename, n, command);
+		}
+	}
+	fclose(file);
+	return true;
+}
+
+// Queues a command for the next tick, recording it when asked to.
+static void Queue(struct Sim* sim, struct Replay* record, int ticks, enum SIM_COMMAND_TYPE type, int arg) {
+	SimQueueCommand(sim, type, arg);
+	if (record) {
+		RecordReplayEvent(record, ticks, REPLAY_COMMAND, type, arg);
+	}
+}
+
+// Cheap stand-in for a player: keeps holding a random set of keys for a while
+// and shoots every few ticks. Uses its own generator, so it doesn't disturb the sim.
+static void RandomInput(struct Sim* sim, struct Replay* record, int ticks, uint64_t* rng) {
+	*rng = *rng * 6364136223846793005ULL + 1442695040888963407ULL;
+	uint32_t r = (uint32_t)(*rng >> 33);
+	if (r % 30 == 0) {
+		Queue(sim, record, ticks, SIM_COMMAND_INPUT, (r >> 8) & (SIM_INPUT_LEFT | SIM_INPUT_RIGHT | SIM_INPUT_UP | SIM_INPUT_DOWN));
+	}
+	if ((r >> 16) % 6 == 0) {
+		Queue(sim, record, ticks, SIM_COMMAND_FIRE, 0);
+	}
+}
+
+// Feeds the events of a replay that are due; the same keys do the same as in
+// game. Returns false once escape was pressed.
+static bool PlayReplay(struct Sim* sim, struct Replay* replay, int ticks, int* input) {
+	for (const struct ReplayEvent* event = NextReplayEvent(replay, ticks); event; event = NextReplayEvent(replay, ticks)) {
+		if (event->kind == REPLAY_COMMAND) {
+			SimQueueCommand(sim, event->code, event->arg);
+			continue;
+		}
+		bool pressed = event->kind == REPLAY_PRESS;
+		if (pressed && (event->code == REPLAY_KEY_ESCAPE)) {
+			return false;
+		}
+		if (pressed && (event->code == REPLAY_KEY_SPACE)) {
+			SimQueueCommand(sim, SIM_COMMAND_FIRE, 0);
+		}
+		int bit = GetReplayKeyInput(event->code);
+		if (bit) {
+			*input = pressed ? (*input | bit) : (*input & ~bit);
+			SimQueueCommand(sim, SIM_COMMAND_INPUT, *input);
+		}
+	}
+	return true;
+}
+
+int main(int argc, char** argv) {
+	struct Options options = {.ticks = 60 * 60 * 5, .seed = 1};
+	bool ticks_given = false;
+
+	for (int i = 1; i < argc; i++) {
+		if ((strcmp(argv[i], "--ticks") == 0) && (i + 1 < argc)) {
+			options.ticks = atoi(argv[++i]);
+			ticks_given = true;
+		} else if ((strcmp(argv[i], "--seed") == 0) && (i + 1 < argc)) {
+			options.seed = strtoull(argv[++i], NULL, 10);
+		} else if ((strcmp(argv[i], "--script") == 0) && (i + 1 < argc)) {
+			options.script = argv[++i];
+		} else if ((strcmp(argv[i], "--load") == 0) && (i + 1 < argc)) {
+			options.load = argv[++i];
+		} else if ((strcmp(argv[i], "--save") == 0) && (i + 1 < argc)) {
+			options.save = argv[++i];
+		} else if ((strcmp(argv[i], "--record") == 0) && (i + 1 < argc)) {
+			options.record = argv[++i];
+		} else if ((strcmp(argv[i], "--replay") == 0) && (i + 1 < argc)) {
+			options.replay = argv[++i];
+		} else if ((strcmp(argv[i], "--threads") == 0) && (i + 1 < argc)) {
+			options.threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--endless") == 0) {
+			options.endless = true;
+		} else {
+			Usage(argv[0]);
+			return 1;
+		}
+	}
+
+	struct ScriptLine* script = NULL;
+	int script_count = 0, script_pos = 0;
+	if (options.script && !LoadScript(options.script, &script, &script_count)) {
+		return 1;
+	}
+
+	struct Replay* replay = NULL;
+	if (options.replay) {
+		replay = LoadReplay(options.replay);
+		if (!replay) {
+			fprintf(stderr, "%s: not a valid replay\n", options.replay);
+			free(script);
+			return 1;
+		}
+		options.seed = replay->seed;
+		if (!ticks_given) {
+			options.ticks = replay->ticks;
+		}
+	}
+
+	struct Sim* sim = CreateSim(options.seed);
+	struct JobPool* jobs = CreateJobPool(options.threads);
+	SetSimJobs(sim, jobs);
+	uint64_t input_rng = options.seed;
+
+	if (options.load) {
+		size_t size = 0;
+		void* snapshot = ReadSnapshotFile(options.load, &size);
+		bool restored = snapshot && RestoreSimSnapshot(sim, snapshot, size, NULL, 0);
+		free(snapshot);
+		if (!restored) {
+			fprintf(stderr, "%s: not a valid snapshot\n", options.load);
+			DestroySim(sim);
+			DestroyJobPool(jobs);
+			if (replay) {
+				DestroyReplay(replay);
+			}
+			free(script);
+			return 1;
+		}
+	}
+	// a recording is only any good when it starts from the seed
+	struct Replay* record = (options.record && !options.load) ? CreateReplay(options.seed) : NULL;
+	if (options.record && !record) {
+		fprintf(stderr, "--record can't be used along with --load\n");
+		DestroySim(sim);
+		DestroyJobPool(jobs);
+		if (replay) {
+			DestroyReplay(replay);
+		}
+		free(script);
+		return 1;
+	}
+	if (!options.load && !options.script && !replay) {
+		Queue(sim, record, 0, SIM_COMMAND_START, 0);
+		Queue(sim, record, 0, SIM_COMMAND_SPAWN_WAVE, 0);
+	}
+
+	int peak = 0, ticks = 0, input = 0;
+	sim->endless = sim->endless || options.endless;
+	if (replay) {
+		if (options.endless && !replay->endless) {
+			fprintf(stderr, "--endless ignored, the replay was recorded without it\n");
+		}
+		sim->endless = replay->endless;
+	}
+	if (record) {
+		record->endless = sim->endless;
+	}
+	double start = Now();
+	for (; ticks < options.ticks && !sim->ended; ticks++) {
+		if (replay) {
+			if (!PlayReplay(sim, replay, ticks, &input)) {
+				break;
+			}
+		} else if (options.script) {
+			while ((script_pos < script_count) && (script[script_pos].tick <= sim->tick)) {
+				Queue(sim, record, ticks, script[script_pos].type, script[script_pos].arg);
+				script_pos++;
+			}
+		} else {
+			RandomInput(sim, record, ticks, &input_rng);
+		}
+		SimStep(sim);
+		if (sim->entities->count > peak) {
+			peak = sim->entities->count;
+		}
+	}
+	double elapsed = Now() - start;
+
+	printf("ticks: %d\n", ticks);
+	printf("seed: %llu\n", (unsigned long long)options.seed);
+	printf("threads: %d\n", GetJobWorkers(jobs));
+	printf("seconds: %.3f\n", elapsed);
+	printf("ticks_per_second: %.1f\n", elapsed > 0 ? ticks / elapsed : 0);
+	printf("realtime_factor: %.1f\n", elapsed > 0 ? ticks / elapsed / SIM_TICKS_PER_SECOND : 0);
+	printf("peak_entities: %d\n", peak);
+	printf("final_entities: %d\n", sim->entities->count);
+	printf("score: %d\n", sim->score);
+	printf("fake_counter: %d\n", sim->fake_counter);
+	printf("ended: %s\n", sim->ended ? "yes" : "no");
+	printf("failed: %s\n", sim->failed ? "yes" : "no");
+
+	int status = 0;
+	if (sim->failed) {
+		fprintf(stderr, "ran out of memory, the results can't be trusted\n");
+		status = 1;
+	}
+	if (record) {
+		record->ticks = ticks;
+		if (!SaveReplay(record, options.record)) {
+			perror(options.record);
+			status = 1;
+		}
+		DestroyReplay(record);
+	}
+	if (replay) {
+		DestroyReplay(replay);
+	}
+	if (options.save) {
+		size_t size = GetSimSnapshotSize(sim, 0);
+		void* snapshot = malloc(size);
+		if (!SaveSimSnapshot(sim, NULL, 0, snapshot, size) || !WriteSnapshotFile(options.save, snapshot, size)) {
+			perror(options.save);
+			status = 1;
+		}
+		free(snapshot);
+	}
+
+	DestroySim(sim);
+	DestroyJobPool(jobs);
+	free(script);
+	return status;
+}
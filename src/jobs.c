@@ -0,0 +1,212 @@
+/*! \file jobs.c
+ *  \brief Work-stealing pool of job threads.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "jobs.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifndef __EMSCRIPTEN__
+#define JOBS_THREADS
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
+
+#ifdef JOBS_THREADS
+
+// Remaining share of a worker as [begin, end) packed into a single word, so
+// that the owner taking from the front and thieves taking from the back can
+// both do it with a single compare-and-swap.
+struct JobQueue {
+	_Atomic uint64_t range;
+	char padding[64 - sizeof(uint64_t)]; // so that no two queues share a cache line
+};
+
+struct JobThread {
+	struct JobPool* pool;
+	int worker;
+	pthread_t thread;
+};
+
+struct JobSync {
+	pthread_mutex_t mutex;
+	pthread_cond_t start, done;
+};
+
+static uint64_t Pack(uint32_t begin, uint32_t end) {
+	return ((uint64_t)begin << 32) | end;
+}
+
+static int TakeFront(struct JobQueue* queue) {
+	uint64_t range = atomic_load(&queue->range);
+	while (true) {
+		uint32_t begin = range >> 32, end = (uint32_t)range;
+		if (begin >= end) {
+			return -1;
+		}
+		if (atomic_compare_exchange_weak(&queue->range, &range, Pack(begin + 1, end))) {
+			return begin;
+		}
+	}
+}
+
+static int TakeBack(struct JobQueue* queue) {
+	uint64_t range = atomic_load(&queue->range);
+	while (true) {
+		uint32_t begin = range >> 32, end = (uint32_t)range;
+		if (begin >= end) {
+			return -1;
+		}
+		if (atomic_compare_exchange_weak(&queue->range, &range, Pack(begin, end - 1))) {
+			return end - 1;
+		}
+	}
+}
+
+static void Work(struct JobPool* pool, int worker) {
+	int workers = pool->threads_count + 1;
+	while (true) {
+		int job = TakeFront(&pool->queues[worker]);
+		for (int i = 1; (job < 0) && (i < workers); i++) {
+			job = TakeBack(&pool->queues[(worker + i) % workers]);
+		}
+		if (job < 0) {
+			return;
+		}
+		pool->func(pool->arg, job, worker);
+	}
+}
+
+static void* Thread(void* arg) {
+	struct JobThread* thread = arg;
+	struct JobPool* pool = thread->pool;
+	struct JobSync* sync = pool->sync;
+	int generation = 0;
+
+	pthread_mutex_lock(&sync->mutex);
+	while (true) {
+		while (!pool->stop && (pool->generation == generation)) {
+			pthread_cond_wait(&sync->start, &sync->mutex);
+		}
+		if (pool->stop) {
+			break;
+		}
+		generation = pool->generation;
+		pthread_mutex_unlock(&sync->mutex);
+
+		Work(pool, thread->worker);
+
+		pthread_mutex_lock(&sync->mutex);
+		if (--pool->active == 0) {
+			pthread_cond_signal(&sync->done);
+		}
+	}
+	pthread_mutex_unlock(&sync->mutex);
+	return NULL;
+}
+
+#endif
+
+struct JobPool* CreateJobPool(int threads) {
+	struct JobPool* pool = calloc(1, sizeof(struct JobPool));
+#ifdef JOBS_THREADS
+	if (threads <= 0) {
+		return pool;
+	}
+	struct JobSync* sync = calloc(1, sizeof(struct JobSync));
+	pthread_mutex_init(&sync->mutex, NULL);
+	pthread_cond_init(&sync->start, NULL);
+	pthread_cond_init(&sync->done, NULL);
+	pool->sync = sync;
+	pool->queues = calloc(threads + 1, sizeof(struct JobQueue));
+	pool->threads = calloc(threads, sizeof(struct JobThread));
+	for (int i = 0; i < threads; i++) {
+		struct JobThread* thread = &pool->threads[pool->threads_count];
+		thread->pool = pool;
+		thread->worker = pool->threads_count + 1;
+		if (pthread_create(&thread->thread, NULL, Thread, thread) == 0) {
+			pool->threads_count++;
+		}
+	}
+	for (int i = 0; i <= pool->threads_count; i++) {
+		atomic_init(&pool->queues[i].range, 0);
+	}
+#else
+	(void)threads;
+#endif
+	return pool;
+}
+
+void DestroyJobPool(struct JobPool* pool) {
+#ifdef JOBS_THREADS
+	struct JobSync* sync = pool->sync;
+	if (sync) {
+		pthread_mutex_lock(&sync->mutex);
+		pool->stop = true;
+		pthread_cond_broadcast(&sync->start);
+		pthread_mutex_unlock(&sync->mutex);
+		for (int i = 0; i < pool->threads_count; i++) {
+			pthread_join(pool->threads[i].thread, NULL);
+		}
+		pthread_mutex_destroy(&sync->mutex);
+		pthread_cond_destroy(&sync->start);
+		pthread_cond_destroy(&sync->done);
+		free(sync);
+	}
+	free(pool->threads);
+	free(pool->queues);
+#endif
+	free(pool);
+}
+
+int GetJobWorkers(const struct JobPool* pool) {
+	return pool ? pool->threads_count + 1 : 1;
+}
+
+void RunJobs(struct JobPool* pool, int count, JobFunction* func, void* arg) {
+	if (!pool || !pool->threads_count || (count <= 1)) {
+		for (int i = 0; i < count; i++) {
+			func(arg, i, 0);
+		}
+		return;
+	}
+#ifdef JOBS_THREADS
+	struct JobSync* sync = pool->sync;
+	int workers = pool->threads_count + 1;
+	for (int i = 0; i < workers; i++) {
+		atomic_store(&pool->queues[i].range, Pack((int64_t)count * i / workers, (int64_t)count * (i + 1) / workers));
+	}
+
+	pthread_mutex_lock(&sync->mutex);
+	pool->func = func;
+	pool->arg = arg;
+	pool->active = pool->threads_count;
+	pool->generation++;
+	pthread_cond_broadcast(&sync->start);
+	pthread_mutex_unlock(&sync->mutex);
+
+	Work(pool, 0);
+
+	pthread_mutex_lock(&sync->mutex);
+	while (pool->active) {
+		pthread_cond_wait(&sync->done, &sync->mutex);
+	}
+	pthread_mutex_unlock(&sync->mutex);
+#endif
+}
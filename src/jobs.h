@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZENEKGIENEK_JOBS_H
+#define ZENEKGIENEK_JOBS_H
+
+#include <stdbool.h>
+
+// Runs a batch of independent jobs on all cores. Every participant (the worker
+// threads and the calling thread) starts with an even, contiguous share of the
+// batch and, once done with it, steals jobs from the end of the others' shares.
+// Like the sim itself, it doesn't use Allegro, so that it can be used by the
+// headless tools; web builds have no threads and run everything on the caller.
+
+typedef void JobFunction(void* arg, int job, int worker);
+
+struct JobQueue;
+struct JobThread;
+
+struct JobPool {
+	int threads_count; // besides the calling thread, which is worker 0
+	struct JobThread* threads;
+	struct JobQueue* queues; // one per worker
+
+	JobFunction* func;
+	void* arg;
+	int generation; // bumped for every batch
+	int active; // threads still busy with the current batch
+	bool stop;
+	void* sync; // mutex and conditions
+};
+
+// Creates a pool with the given number of extra threads; 0 makes RunJobs
+// run everything on the calling thread.
+struct JobPool* CreateJobPool(int threads);
+void DestroyJobPool(struct JobPool* pool);
+// Number of workers, i.e. the range of `worker` passed to job functions.
+int GetJobWorkers(const struct JobPool* pool);
+// Calls func for every job in [0, count) and returns once all of them are done.
+// NULL pool runs them in order on the calling thread.
+void RunJobs(struct JobPool* pool, int count, JobFunction* func, void* arg);
+
+#endif
@@ -0,0 +1,196 @@
+/*! \file loadpool.c
+ *  \brief Concurrent asset decoding for gamestate loading.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "loadpool.h"
+#include "assetpack.h"
+#include <stdlib.h>
+#include <string.h>
+
+enum LOAD_JOB_TYPE {
+	LOAD_BITMAP,
+	LOAD_FONT,
+	LOAD_SAMPLE
+};
+
+struct LoadJob {
+	enum LOAD_JOB_TYPE type;
+	void* result;
+	char *path, *name;
+	int size, flags;
+	struct PCMCache* cache;
+	int bitmap_flags, bitmap_format;
+	struct LoadJob* next;
+};
+
+static void Run(struct LoadJob* job) {
+	al_set_new_bitmap_flags(job->bitmap_flags);
+	al_set_new_bitmap_format(job->bitmap_format);
+	switch (job->type) {
+		case LOAD_BITMAP:
+			*(ALLEGRO_BITMAP**)job->result = al_load_bitmap(job->path);
+			break;
+		case LOAD_FONT:
+			*(ALLEGRO_FONT**)job->result = al_load_font(job->path, job->size, job->flags);
+			break;
+		case LOAD_SAMPLE:
+			*(ALLEGRO_SAMPLE**)job->result = LoadCachedSample(job->cache, job->name, job->path);
+			break;
+	}
+	free(job->path);
+	free(job->name);
+	free(job);
+}
+
+static void* Worker(ALLEGRO_THREAD* thread, void* arg) {
+	struct LoadPool* pool = arg;
+	UseAssetPack();
+	al_lock_mutex(pool->mutex);
+	while (true) {
+		while (!pool->first && !pool->stop) {
+			al_wait_cond(pool->cond, pool->mutex);
+		}
+		if (!pool->first) {
+			break;
+		}
+		struct LoadJob* job = pool->first;
+		pool->first = job->next;
+		if (!pool->first) {
+			pool->last = NULL;
+		}
+		al_unlock_mutex(pool->mutex);
+
+		Run(job);
+
+		al_lock_mutex(pool->mutex);
+		pool->pending--;
+		pool->done++;
+		al_broadcast_cond(pool->cond);
+	}
+	al_unlock_mutex(pool->mutex);
+	return NULL;
+}
+
+struct LoadPool* CreateLoadPool(struct Game* game, void (*progress)(struct Game*)) {
+	struct LoadPool* pool = calloc(1, sizeof(struct LoadPool));
+	pool->game = game;
+	pool->progress = progress;
+#ifndef __EMSCRIPTEN__
+	// the loading thread keeps working too, so leave one core for it
+	int count = al_get_cpu_count() - 1;
+	if (count < 1) {
+		count = 1;
+	}
+	pool->mutex = al_create_mutex();
+	pool->cond = al_create_cond();
+	pool->threads = calloc(count, sizeof(ALLEGRO_THREAD*));
+	for (int i = 0; i < count; i++) {
+		pool->threads[pool->threads_count] = al_create_thread(Worker, pool);
+		if (pool->threads[pool->threads_count]) {
+			al_start_thread(pool->threads[pool->threads_count++]);
+		}
+	}
+#endif
+	return pool;
+}
+
+static void Queue(struct LoadPool* pool, struct LoadJob* job) {
+	job->bitmap_flags = al_get_new_bitmap_flags();
+	job->bitmap_format = al_get_new_bitmap_format();
+
+	if (!pool->threads_count) {
+		Run(job);
+		pool->progress(pool->game);
+		return;
+	}
+
+	al_lock_mutex(pool->mutex);
+	if (pool->last) {
+		pool->last->next = job;
+	} else {
+		pool->first = job;
+	}
+	pool->last = job;
+	pool->pending++;
+	al_signal_cond(pool->cond);
+	al_unlock_mutex(pool->mutex);
+}
+
+void LoadBitmapAsync(struct LoadPool* pool, ALLEGRO_BITMAP** bitmap, const char* path) {
+	struct LoadJob* job = calloc(1, sizeof(struct LoadJob));
+	*job = (struct LoadJob){.type = LOAD_BITMAP, .result = bitmap, .path = strdup(path)};
+	Queue(pool, job);
+}
+
+void LoadFontAsync(struct LoadPool* pool, ALLEGRO_FONT** font, const char* path, int size, int flags) {
+	struct LoadJob* job = calloc(1, sizeof(struct LoadJob));
+	*job = (struct LoadJob){.type = LOAD_FONT, .result = font, .path = strdup(path), .size = size, .flags = flags};
+	Queue(pool, job);
+}
+
+void LoadSampleAsync(struct LoadPool* pool, ALLEGRO_SAMPLE** sample, struct PCMCache* cache, const char* name, const char* path) {
+	struct LoadJob* job = calloc(1, sizeof(struct LoadJob));
+	*job = (struct LoadJob){.type = LOAD_SAMPLE, .result = sample, .path = strdup(path), .name = strdup(name), .cache = cache};
+	Queue(pool, job);
+}
+
+void PumpLoadPool(struct LoadPool* pool) {
+	if (!pool->threads_count) {
+		return;
+	}
+	al_lock_mutex(pool->mutex);
+	while (pool->reported < pool->done) {
+		pool->reported++;
+		// progress may take a while (e.g. to draw the loading screen), so don't hold the workers back
+		al_unlock_mutex(pool->mutex);
+		pool->progress(pool->game);
+		al_lock_mutex(pool->mutex);
+	}
+	al_unlock_mutex(pool->mutex);
+}
+
+void FinishLoadPool(struct LoadPool* pool) {
+	if (pool->threads_count) {
+		al_lock_mutex(pool->mutex);
+		while (pool->pending || (pool->reported < pool->done)) {
+			if (pool->reported < pool->done) {
+				pool->reported++;
+				al_unlock_mutex(pool->mutex);
+				pool->progress(pool->game);
+				al_lock_mutex(pool->mutex);
+				continue;
+			}
+			al_wait_cond(pool->cond, pool->mutex);
+		}
+		pool->stop = true;
+		al_broadcast_cond(pool->cond);
+		al_unlock_mutex(pool->mutex);
+
+		for (int i = 0; i < pool->threads_count; i++) {
+			al_join_thread(pool->threads[i], NULL);
+			al_destroy_thread(pool->threads[i]);
+		}
+	}
+	if (pool->mutex) {
+		al_destroy_mutex(pool->mutex);
+		al_destroy_cond(pool->cond);
+	}
+	free(pool->threads);
+	free(pool);
+}
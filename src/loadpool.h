@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZENEKGIENEK_LOADPOOL_H
+#define ZENEKGIENEK_LOADPOOL_H
+
+#include "pcmcache.h"
+#include <libsuperderpy.h>
+
+// Decodes assets on a pool of worker threads while Gamestate_Load carries on
+// with whatever has to stay on its own thread. Bitmaps are created with the
+// new bitmap flags and format that were set when they were queued, so they end
+// up as memory bitmaps converted by the engine just like the ones loaded
+// directly. Paths have to be resolved beforehand, as GetDataFilePath isn't
+// thread-safe.
+
+struct LoadJob;
+
+struct LoadPool {
+	struct Game* game;
+	void (*progress)(struct Game*);
+	struct LoadJob *first, *last;
+	int pending; // queued or being loaded
+	int done, reported;
+	bool stop;
+	ALLEGRO_MUTEX* mutex;
+	ALLEGRO_COND* cond;
+	ALLEGRO_THREAD** threads;
+	int threads_count;
+};
+
+struct LoadPool* CreateLoadPool(struct Game* game, void (*progress)(struct Game*));
+void LoadBitmapAsync(struct LoadPool* pool, ALLEGRO_BITMAP** bitmap, const char* path);
+void LoadFontAsync(struct LoadPool* pool, ALLEGRO_FONT** font, const char* path, int size, int flags);
+void LoadSampleAsync(struct LoadPool* pool, ALLEGRO_SAMPLE** sample, struct PCMCache* cache, const char* name, const char* path);
+// Reports progress of all the jobs finished so far. Every job counts as one step.
+void PumpLoadPool(struct LoadPool* pool);
+// Waits for all the jobs to finish, reporting their progress, and destroys the pool.
+void FinishLoadPool(struct LoadPool* pool);
+
+#endif
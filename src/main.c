@@ -19,6 +19,7 @@
  */
 
 #include "common.h"
+#include "assetpack.h"
 #include "defines.h"
 #include <libsuperderpy.h>
 #include <signal.h>
@@ -44,10 +45,17 @@ int main(int argc, char** argv) {
 			.handlers = (struct Handlers){
 				.event = GlobalEventHandler,
 				.destroy = DestroyGameData,
+				.postdraw = GlobalPostDraw,
 			},
 		});
 	if (!game) { return 1; }
 
+	// without a pack, everything keeps being loaded from loose files
+	char* pack_path = FindDataFilePath(game, "data.pack");
+	struct AssetPack* pack = OpenAssetPack(pack_path);
+	free(pack_path);
+	MountAssetPack(pack);
+
 	LoadGamestate(game, "dosowisko");
 	StartGamestate(game, "dosowisko");
 
@@ -55,5 +63,8 @@ int main(int argc, char** argv) {
 
 	al_hide_mouse_cursor(game->display);
 
-	return libsuperderpy_run(game);
+	int ret = libsuperderpy_run(game);
+	UnmountAssetPack();
+	CloseAssetPack(pack);
+	return ret;
 }
@@ -0,0 +1,102 @@
+/*! \file movement.c
+ *  \brief Batched entity movement kernels.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "movement.h"
+#include <stddef.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define MOVEMENT_SSE2
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define MOVEMENT_AVX2
+#endif
+
+typedef void MovementKernel(double*, double*, double*, const double*, const double*, double, int);
+
+void MoveEntitiesScalar(double* x, double* y, double* distance, const double* dx, const double* dy, double step, int count) {
+	for (int i = 0; i < count; i++) {
+		x[i] += dx[i] * step;
+		y[i] += dy[i] * step;
+		distance[i] += step;
+	}
+}
+
+#ifdef MOVEMENT_SSE2
+static void MoveEntitiesSSE2(double* x, double* y, double* distance, const double* dx, const double* dy, double step, int count) {
+	__m128d s = _mm_set1_pd(step);
+	int i = 0;
+	for (; i + 2 <= count; i += 2) {
+		_mm_storeu_pd(x + i, _mm_add_pd(_mm_loadu_pd(x + i), _mm_mul_pd(_mm_loadu_pd(dx + i), s)));
+		_mm_storeu_pd(y + i, _mm_add_pd(_mm_loadu_pd(y + i), _mm_mul_pd(_mm_loadu_pd(dy + i), s)));
+		_mm_storeu_pd(distance + i, _mm_add_pd(_mm_loadu_pd(distance + i), s));
+	}
+	MoveEntitiesScalar(x + i, y + i, distance + i, dx + i, dy + i, step, count - i);
+}
+#endif
+
+#ifdef MOVEMENT_AVX2
+__attribute__((target("avx2"))) static void MoveEntitiesAVX2(double* x, double* y, double* distance, const double* dx, const double* dy, double step, int count) {
+	__m256d s = _mm256_set1_pd(step);
+	int i = 0;
+	// separate mul and add (no FMA), rounding the same way as the plain C expression
+	for (; i + 4 <= count; i += 4) {
+		_mm256_storeu_pd(x + i, _mm256_add_pd(_mm256_loadu_pd(x + i), _mm256_mul_pd(_mm256_loadu_pd(dx + i), s)));
+		_mm256_storeu_pd(y + i, _mm256_add_pd(_mm256_loadu_pd(y + i), _mm256_mul_pd(_mm256_loadu_pd(dy + i), s)));
+		_mm256_storeu_pd(distance + i, _mm256_add_pd(_mm256_loadu_pd(distance + i), s));
+	}
+	MoveEntitiesScalar(x + i, y + i, distance + i, dx + i, dy + i, step, count - i);
+}
+#endif
+
+static MovementKernel* kernel = NULL;
+static const char* kernel_name = NULL;
+
+static void PickKernel(void) {
+	kernel = MoveEntitiesScalar;
+	kernel_name = "scalar";
+#ifdef MOVEMENT_SSE2
+	kernel = MoveEntitiesSSE2;
+	kernel_name = "sse2";
+#endif
+#ifdef MOVEMENT_AVX2
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		kernel = MoveEntitiesAVX2;
+		kernel_name = "avx2";
+	}
+#endif
+}
+
+void MoveEntities(double* x, double* y, double* distance, const double* dx, const double* dy, double step, int count) {
+	if (!kernel) {
+		PickKernel();
+	}
+	kernel(x, y, distance, dx, dy, step, count);
+}
+
+const char* GetMovementKernelName(void) {
+	if (!kernel) {
+		PickKernel();
+	}
+	return kernel_name;
+}
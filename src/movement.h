@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZENEKGIENEK_MOVEMENT_H
+#define ZENEKGIENEK_MOVEMENT_H
+
+// Advances `count` entities by `step` along their cached direction vectors:
+//   x += dx * step, y += dy * step, distance += step
+// Uses AVX2 or SSE2 when available, picked at first call.
+void MoveEntities(double* x, double* y, double* distance, const double* dx, const double* dy, double step, int count);
+
+// Portable implementation, always available.
+void MoveEntitiesScalar(double* x, double* y, double* distance, const double* dx, const double* dy, double step, int count);
+
+// Name of the implementation MoveEntities dispatches to ("avx2", "sse2" or "scalar").
+const char* GetMovementKernelName(void);
+
+#endif
@@ -0,0 +1,104 @@
+/*! \file numbers.c
+ *  \brief Batched integer rendering from a pre-rendered glyph strip.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "numbers.h"
+#include <stdio.h>
+
+#define NUMBER_PADDING 1
+
+struct NumberFont* CreateNumberFont(struct Game* game, ALLEGRO_FONT* font) {
+	struct NumberFont* numbers = calloc(1, sizeof(struct NumberFont));
+	numbers->font = font;
+
+	int x = NUMBER_PADDING, height = 0;
+	for (int i = 0; i < NUMBER_GLYPHS_COUNT; i++) {
+		int bbx = 0, bby = 0, bbw = 0, bbh = 0;
+		al_get_glyph_dimensions(font, NUMBER_GLYPHS[i], &bbx, &bby, &bbw, &bbh);
+		numbers->regions[i] = (struct AtlasRegion){.x = x, .y = NUMBER_PADDING, .w = bbw, .h = bbh};
+		numbers->bbx[i] = bbx;
+		numbers->bby[i] = bby;
+		x += bbw + NUMBER_PADDING;
+		if (bbh > height) {
+			height = bbh;
+		}
+	}
+
+	numbers->bitmap = al_create_bitmap(x, height + 2 * NUMBER_PADDING);
+	if (!numbers->bitmap) {
+		PrintConsole(game, "Couldn't create number glyph strip!");
+		return numbers;
+	}
+	ALLEGRO_BITMAP* target = al_get_target_bitmap();
+	al_set_target_bitmap(numbers->bitmap);
+	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+	for (int i = 0; i < NUMBER_GLYPHS_COUNT; i++) {
+		struct AtlasRegion* region = &numbers->regions[i];
+		al_draw_glyph(font, al_map_rgb(255, 255, 255), region->x - numbers->bbx[i], region->y - numbers->bby[i], NUMBER_GLYPHS[i]);
+	}
+	al_set_target_bitmap(target);
+	return numbers;
+}
+
+void DestroyNumberFont(struct NumberFont* numbers) {
+	if (numbers->bitmap) {
+		al_destroy_bitmap(numbers->bitmap);
+	}
+	free(numbers);
+}
+
+static struct NumberLayout* GetLayout(struct NumberFont* numbers, int value) {
+	// scores are mostly multiples of 100, so take the top bits of a multiplicative hash
+	struct NumberLayout* layout = &numbers->cache[((uint32_t)value * 2654435761u) >> (32 - NUMBER_CACHE_BITS)];
+	if (layout->used && (layout->value == value)) {
+		return layout;
+	}
+
+	char text[NUMBER_MAX_LENGTH + 1];
+	snprintf(text, sizeof(text), "%d", value);
+	*layout = (struct NumberLayout){.value = value, .used = true, .width = al_get_text_width(numbers->font, text)};
+	float pen = 0;
+	for (const char* c = text; *c; c++) {
+		layout->glyphs[layout->count] = (*c == '-') ? 0 : (*c - '0' + 1);
+		layout->offsets[layout->count] = pen;
+		layout->count++;
+		// includes kerning against the next character, just like text drawing does
+		pen += al_get_glyph_advance(numbers->font, *c, c[1] ? c[1] : ALLEGRO_NO_KERNING);
+	}
+	return layout;
+}
+
+void BatchNumber(struct NumberFont* numbers, struct VertexBatch* batch, float x, float y, int align, int value, ALLEGRO_COLOR color) {
+	if (!numbers->bitmap) {
+		al_draw_textf(numbers->font, color, x, y, align, "%d", value);
+		return;
+	}
+	struct NumberLayout* layout = GetLayout(numbers, value);
+	if (align == ALLEGRO_ALIGN_CENTER) {
+		x -= layout->width / 2.0f;
+	} else if (align == ALLEGRO_ALIGN_RIGHT) {
+		x -= layout->width;
+	}
+	for (int i = 0; i < layout->count; i++) {
+		int g = layout->glyphs[i];
+		struct AtlasRegion* region = &numbers->regions[g];
+		float gx = x + layout->offsets[i] + numbers->bbx[g], gy = y + numbers->bby[g];
+		BatchQuad(batch, gx, gy, gx + region->w, gy + region->h, region->x, region->y, region->x + region->w, region->y + region->h, color);
+	}
+}
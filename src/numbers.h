@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZENEKGIENEK_NUMBERS_H
+#define ZENEKGIENEK_NUMBERS_H
+
+#include "atlas.h"
+#include <libsuperderpy.h>
+
+// Draws integers with a font without going through its glyph lookup every time:
+// the sign and digits are rendered once into a small strip and numbers become
+// quads in a VertexBatch. Glyph placement of every distinct value is cached, so
+// repeated values (like the few explosion scores) are never laid out twice.
+
+#define NUMBER_GLYPHS "-0123456789"
+#define NUMBER_GLYPHS_COUNT 11
+#define NUMBER_CACHE_BITS 6
+#define NUMBER_CACHE_SIZE (1 << NUMBER_CACHE_BITS)
+#define NUMBER_MAX_LENGTH 12
+
+struct NumberLayout {
+	int value;
+	bool used;
+	int count;
+	float width; // same as al_get_text_width would return
+	unsigned char glyphs[NUMBER_MAX_LENGTH];
+	float offsets[NUMBER_MAX_LENGTH]; // pen positions relative to the start
+};
+
+struct NumberFont {
+	ALLEGRO_FONT* font;
+	ALLEGRO_BITMAP* bitmap; // NULL when it couldn't be created; numbers are drawn as text then
+	struct AtlasRegion regions[NUMBER_GLYPHS_COUNT];
+	float bbx[NUMBER_GLYPHS_COUNT], bby[NUMBER_GLYPHS_COUNT];
+	struct NumberLayout cache[NUMBER_CACHE_SIZE];
+};
+
+struct NumberFont* CreateNumberFont(struct Game* game, ALLEGRO_FONT* font);
+void DestroyNumberFont(struct NumberFont* numbers);
+// Places the number the same way al_draw_textf(font, color, x, y, align, "%d", value) would.
+void BatchNumber(struct NumberFont* numbers, struct VertexBatch* batch, float x, float y, int align, int value, ALLEGRO_COLOR color);
+
+#endif
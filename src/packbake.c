@@ -0,0 +1,131 @@
+/*! \file packbake.c
+ *  \brief Packs data files into a single indexed asset pack.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "assetpackformat.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool Pad(FILE* file) {
+	static const char zeros[ASSET_PACK_ALIGNMENT];
+	long pos = ftell(file);
+	if (pos < 0) {
+		return false;
+	}
+	size_t padding = (ASSET_PACK_ALIGNMENT - pos % ASSET_PACK_ALIGNMENT) % ASSET_PACK_ALIGNMENT;
+	return fwrite(zeros, 1, padding, file) == padding;
+}
+
+static bool AppendFile(FILE* out, const char* path, uint64_t size) {
+	FILE* in = fopen(path, "rb");
+	if (!in) {
+		return false;
+	}
+	char buf[65536];
+	size_t n;
+	uint64_t copied = 0;
+	while ((n = fread(buf, 1, sizeof(buf), in)) && (fwrite(buf, 1, n, out) == n)) {
+		copied += n;
+	}
+	fclose(in);
+	return copied == size;
+}
+
+static int CompareNames(const void* a, const void* b) {
+	return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+int main(int argc, char** argv) {
+	if (argc < 4) {
+		fprintf(stderr, "Usage: %s DATADIR OUTPUT FILE...\n", argv[0]);
+		fprintf(stderr, "Packs given files (relative to DATADIR) into an asset pack at OUTPUT.\n");
+		return 1;
+	}
+	const char *datadir = argv[1], *output = argv[2];
+	int count = argc - 3;
+
+	// the runtime looks entries up with a binary search
+	const char** names = malloc(sizeof(char*) * count);
+	for (int i = 0; i < count; i++) {
+		names[i] = argv[i + 3];
+	}
+	qsort(names, count, sizeof(char*), CompareNames);
+
+	struct AssetPackHeader header = {.magic = ASSET_PACK_MAGIC, .version = ASSET_PACK_VERSION, .count = count};
+	struct AssetPackEntry* entries = calloc(count, sizeof(struct AssetPackEntry));
+
+	uint64_t offset = sizeof(header) + sizeof(struct AssetPackEntry) * count;
+	for (int i = 0; i < count; i++) {
+		const char* name = names[i];
+		char path[4096];
+		snprintf(path, sizeof(path), "%s/%s", datadir, name);
+		if (strlen(name) >= sizeof(entries[i].name)) {
+			fprintf(stderr, "%s: name too long\n", name);
+			return 1;
+		}
+		if ((i > 0) && (strcmp(names[i - 1], name) == 0)) {
+			fprintf(stderr, "%s: given twice\n", name);
+			return 1;
+		}
+		FILE* file = fopen(path, "rb");
+		if (!file || (fseek(file, 0, SEEK_END) != 0)) {
+			perror(path);
+			return 1;
+		}
+		long size = ftell(file);
+		fclose(file);
+
+		struct AssetPackEntry* entry = &entries[i];
+		strncpy(entry->name, name, sizeof(entry->name) - 1);
+		entry->size = size;
+		offset = (offset + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT;
+		entry->offset = offset;
+		offset += entry->size;
+	}
+
+	// write to a temporary file first, so a running game never maps a half-written pack
+	char tmp[4096];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", output);
+	FILE* file = fopen(tmp, "wb");
+	if (!file) {
+		perror(tmp);
+		return 1;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = ok && fwrite(entries, sizeof(struct AssetPackEntry), count, file) == (size_t)count;
+	for (int i = 0; ok && i < count; i++) {
+		char path[4096];
+		snprintf(path, sizeof(path), "%s/%s", datadir, names[i]);
+		ok = Pad(file) && AppendFile(file, path, entries[i].size);
+	}
+	ok = (fclose(file) == 0) && ok;
+	remove(output);
+	if (!ok || (rename(tmp, output) != 0)) {
+		fprintf(stderr, "Couldn't write %s!\n", output);
+		remove(tmp);
+		return 1;
+	}
+
+	printf("%s: %d files, %llu bytes\n", output, count, (unsigned long long)offset);
+	free(entries);
+	free(names);
+	return 0;
+}
@@ -0,0 +1,114 @@
+/*! \file pcmbake.c
+ *  \brief Build step decoding sound effects into the PCM cache.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pcmcache.h"
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_acodec.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool Pad(FILE* file) {
+	static const char zeros[PCM_CACHE_ALIGNMENT];
+	long pos = ftell(file);
+	if (pos < 0) {
+		return false;
+	}
+	size_t padding = (PCM_CACHE_ALIGNMENT - pos % PCM_CACHE_ALIGNMENT) % PCM_CACHE_ALIGNMENT;
+	return fwrite(zeros, 1, padding, file) == padding;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 4) {
+		fprintf(stderr, "Usage: %s DATADIR OUTPUT FILE...\n", argv[0]);
+		fprintf(stderr, "Decodes given files (relative to DATADIR) into a PCM cache at OUTPUT.\n");
+		return 1;
+	}
+	const char *datadir = argv[1], *output = argv[2];
+	int count = argc - 3;
+
+	if (!al_init() || !al_install_audio() || !al_init_acodec_addon()) {
+		fprintf(stderr, "Couldn't initialize Allegro audio!\n");
+		return 1;
+	}
+
+	struct PCMCacheHeader header = {.magic = PCM_CACHE_MAGIC, .version = PCM_CACHE_VERSION, .count = count};
+	struct PCMCacheEntry* entries = calloc(count, sizeof(struct PCMCacheEntry));
+	ALLEGRO_SAMPLE** samples = calloc(count, sizeof(ALLEGRO_SAMPLE*));
+
+	uint64_t offset = sizeof(header) + sizeof(struct PCMCacheEntry) * count;
+	for (int i = 0; i < count; i++) {
+		const char* name = argv[i + 3];
+		char path[4096];
+		snprintf(path, sizeof(path), "%s/%s", datadir, name);
+		if (strlen(name) >= sizeof(entries[i].name)) {
+			fprintf(stderr, "%s: name too long\n", name);
+			return 1;
+		}
+		samples[i] = al_load_sample(path);
+		if (!samples[i]) {
+			fprintf(stderr, "%s: couldn't decode\n", path);
+			return 1;
+		}
+
+		struct PCMCacheEntry* entry = &entries[i];
+		strncpy(entry->name, name, sizeof(entry->name) - 1);
+		entry->hash = HashFile(path);
+		if (!GetFileStamp(path, &entry->source_size, &entry->source_mtime)) {
+			fprintf(stderr, "%s: couldn't stat\n", path);
+			return 1;
+		}
+		entry->samples = al_get_sample_length(samples[i]);
+		entry->frequency = al_get_sample_frequency(samples[i]);
+		entry->depth = al_get_sample_depth(samples[i]);
+		entry->channels = al_get_sample_channels(samples[i]);
+		entry->size = (uint64_t)entry->samples * al_get_channel_count(entry->channels) * al_get_audio_depth_size(entry->depth);
+		offset = (offset + PCM_CACHE_ALIGNMENT - 1) / PCM_CACHE_ALIGNMENT * PCM_CACHE_ALIGNMENT;
+		entry->offset = offset;
+		offset += entry->size;
+	}
+
+	// write to a temporary file first, so a running game never maps a half-written cache
+	char tmp[4096];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", output);
+	FILE* file = fopen(tmp, "wb");
+	if (!file) {
+		perror(tmp);
+		return 1;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = ok && fwrite(entries, sizeof(struct PCMCacheEntry), count, file) == (size_t)count;
+	for (int i = 0; ok && i < count; i++) {
+		ok = Pad(file) && (fwrite(al_get_sample_data(samples[i]), 1, entries[i].size, file) == entries[i].size);
+		al_destroy_sample(samples[i]);
+	}
+	ok = (fclose(file) == 0) && ok;
+	remove(output);
+	if (!ok || (rename(tmp, output) != 0)) {
+		fprintf(stderr, "Couldn't write %s!\n", output);
+		remove(tmp);
+		return 1;
+	}
+
+	printf("%s: %d samples, %llu bytes\n", output, count, (unsigned long long)offset);
+	free(entries);
+	free(samples);
+	return 0;
+}
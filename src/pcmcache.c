@@ -0,0 +1,183 @@
+/*! \file pcmcache.c
+ *  \brief Memory-mapped cache of decoded sound effects.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pcmcache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif !defined(__EMSCRIPTEN__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define PCM_CACHE_MMAP
+#endif
+
+uint64_t HashFile(const char* path) {
+	ALLEGRO_FILE* file = al_fopen(path, "rb");
+	if (!file) {
+		return 0;
+	}
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	unsigned char buf[16384];
+	size_t n;
+	while ((n = al_fread(file, buf, sizeof(buf)))) {
+		for (size_t i = 0; i < n; i++) {
+			hash ^= buf[i];
+			hash *= 0x100000001b3ULL;
+		}
+	}
+	al_fclose(file);
+	return hash;
+}
+
+bool GetFileStamp(const char* path, uint64_t* size, int64_t* mtime) {
+	struct stat st;
+	if (stat(path, &st) != 0) {
+		return false;
+	}
+	*size = st.st_size;
+	*mtime = st.st_mtime;
+	return true;
+}
+
+static bool IsStale(const struct PCMCacheEntry* entry, const char* path) {
+	uint64_t size;
+	int64_t mtime;
+	if (GetFileStamp(path, &size, &mtime)) {
+		return (size != entry->source_size) || (mtime != entry->source_mtime);
+	}
+	// not loose, so it comes from the asset pack, which gets built along with the cache
+	ALLEGRO_FILE* file = al_fopen(path, "rb");
+	if (!file) {
+		return true;
+	}
+	bool stale = (uint64_t)al_fsize(file) != entry->source_size;
+	al_fclose(file);
+	return stale;
+}
+
+static bool Validate(struct PCMCache* cache) {
+	if (cache->size < sizeof(struct PCMCacheHeader)) {
+		return false;
+	}
+	cache->header = cache->data;
+	if ((memcmp(cache->header->magic, PCM_CACHE_MAGIC, sizeof(cache->header->magic)) != 0) || (cache->header->version != PCM_CACHE_VERSION)) {
+		return false;
+	}
+	if (sizeof(struct PCMCacheHeader) + (uint64_t)cache->header->count * sizeof(struct PCMCacheEntry) > cache->size) {
+		return false;
+	}
+	cache->entries = (struct PCMCacheEntry*)(cache->header + 1);
+	for (uint32_t i = 0; i < cache->header->count; i++) {
+		struct PCMCacheEntry* entry = &cache->entries[i];
+		if ((entry->offset > cache->size) || (entry->size > cache->size - entry->offset) || (entry->offset % PCM_CACHE_ALIGNMENT)) {
+			return false;
+		}
+		if ((uint64_t)entry->samples * al_get_channel_count(entry->channels) * al_get_audio_depth_size(entry->depth) != entry->size) {
+			return false;
+		}
+	}
+	return true;
+}
+
+struct PCMCache* OpenPCMCache(const char* path) {
+	if (!path) {
+		return NULL;
+	}
+	struct PCMCache* cache = calloc(1, sizeof(struct PCMCache));
+#if defined(_WIN32)
+	cache->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (cache->file == INVALID_HANDLE_VALUE) {
+		free(cache);
+		return NULL;
+	}
+	LARGE_INTEGER size;
+	GetFileSizeEx(cache->file, &size);
+	cache->size = size.QuadPart;
+	cache->mapping = CreateFileMappingA(cache->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	cache->data = cache->mapping ? MapViewOfFile(cache->mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+#elif defined(PCM_CACHE_MMAP)
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if ((fd < 0) || (fstat(fd, &st) != 0) || (st.st_size == 0)) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		free(cache);
+		return NULL;
+	}
+	cache->size = st.st_size;
+	cache->data = mmap(NULL, cache->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (cache->data == MAP_FAILED) {
+		cache->data = NULL;
+	}
+	close(fd); // the mapping stays valid
+#endif
+	if (!cache->data || !Validate(cache)) {
+		ClosePCMCache(cache);
+		return NULL;
+	}
+	return cache;
+}
+
+void ClosePCMCache(struct PCMCache* cache) {
+	if (!cache) {
+		return;
+	}
+#if defined(_WIN32)
+	if (cache->data) {
+		UnmapViewOfFile(cache->data);
+	}
+	if (cache->mapping) {
+		CloseHandle(cache->mapping);
+	}
+	CloseHandle(cache->file);
+#elif defined(PCM_CACHE_MMAP)
+	if (cache->data) {
+		munmap(cache->data, cache->size);
+	}
+#endif
+	free(cache);
+}
+
+ALLEGRO_SAMPLE* LoadCachedSample(struct PCMCache* cache, const char* name, const char* path) {
+	if (cache) {
+		for (uint32_t i = 0; i < cache->header->count; i++) {
+			struct PCMCacheEntry* entry = &cache->entries[i];
+			if (strncmp(entry->name, name, sizeof(entry->name)) != 0) {
+				continue;
+			}
+			if (IsStale(entry, path)) {
+				break; // stale, the source has changed since
+			}
+			// the buffer belongs to the mapping, so Allegro must not free it
+			ALLEGRO_SAMPLE* sample = al_create_sample((char*)cache->data + entry->offset, entry->samples, entry->frequency, entry->depth, entry->channels, false);
+			if (sample) {
+				return sample;
+			}
+			break;
+		}
+	}
+	return al_load_sample(path);
+}
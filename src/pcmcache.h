@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZENEKGIENEK_PCMCACHE_H
+#define ZENEKGIENEK_PCMCACHE_H
+
+#include <allegro5/allegro_audio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Sound effects decoded ahead of time (by zenekgienek_pcmbake) into a single
+// file that gets memory-mapped at runtime, so that the samples play straight
+// out of the page cache without any FLAC decoding.
+//
+// Layout: PCMCacheHeader, followed by `count` PCMCacheEntry records; sample
+// data of every entry starts at a multiple of PCM_CACHE_ALIGNMENT.
+
+#define PCM_CACHE_MAGIC "ZGPCMv2"
+#define PCM_CACHE_VERSION 2
+#define PCM_CACHE_ALIGNMENT 4096
+
+struct PCMCacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t count;
+};
+
+struct PCMCacheEntry {
+	char name[64]; // path relative to the data directory
+	uint64_t hash; // of the source file, see HashFile
+	uint64_t source_size; // stamp that's checked at runtime, see GetFileStamp
+	int64_t source_mtime;
+	uint64_t offset, size;
+	uint32_t samples, frequency;
+	uint32_t depth, channels; // ALLEGRO_AUDIO_DEPTH and ALLEGRO_CHANNEL_CONF
+};
+
+struct PCMCache {
+	void* data;
+	size_t size;
+	struct PCMCacheHeader* header;
+	struct PCMCacheEntry* entries;
+#ifdef _WIN32
+	void *file, *mapping;
+#endif
+};
+
+// Returns NULL when there's no usable cache at given path.
+struct PCMCache* OpenPCMCache(const char* path);
+// Must not be called before all the samples from this cache are destroyed.
+void ClosePCMCache(struct PCMCache* cache);
+// Takes the sample from the cache if it's there and the file at path still has
+// the same stamp, otherwise (or when cache is NULL) loads that file with al_load_sample.
+ALLEGRO_SAMPLE* LoadCachedSample(struct PCMCache* cache, const char* name, const char* path);
+// FNV-1a of the whole file, 0 when it can't be read. Too slow to check at
+// every start; only recorded when baking.
+uint64_t HashFile(const char* path);
+// Size and modification time of a loose file; false when there's no such file.
+bool GetFileStamp(const char* path, uint64_t* size, int64_t* mtime);
+
+#endif
@@ -0,0 +1,205 @@
+/*! \file profiler.c
+ *  \brief Frame phase timing, overlay and trace export.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "profiler.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct Profiler* CreateProfiler(void) {
+	struct Profiler* prof = calloc(1, sizeof(struct Profiler));
+	prof->frame_start = al_get_time();
+	return prof;
+}
+
+void DestroyProfiler(struct Profiler* prof) {
+	StopProfilerTrace(prof);
+	if (prof->font) {
+		al_destroy_font(prof->font);
+	}
+	free(prof);
+}
+
+// Zone names are usually string literals, so comparing pointers is enough most of the time.
+static int FindZone(struct Profiler* prof, const char* name) {
+	for (int i = 0; i < prof->zones_count; i++) {
+		if ((prof->zones[i].name == name) || (strcmp(prof->zones[i].name, name) == 0)) {
+			return i;
+		}
+	}
+	if (prof->zones_count == PROFILER_MAX_ZONES) {
+		return -1;
+	}
+	prof->zones[prof->zones_count].name = name;
+	return prof->zones_count++;
+}
+
+static void TraceEvent(struct Profiler* prof, const char* name, double start, double duration) {
+	fprintf(prof->trace, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+		prof->trace_empty ? "\n" : ",\n", name, (start - prof->trace_start) * 1e6, duration * 1e6);
+	prof->trace_empty = false;
+}
+
+void ProfilerBegin(struct Profiler* prof, const char* name) {
+	if (!prof) {
+		return;
+	}
+	// too deep zones are still counted, so that ProfilerEnd stays balanced
+	if (prof->depth < PROFILER_MAX_DEPTH) {
+		prof->stack[prof->depth].zone = FindZone(prof, name);
+		prof->stack[prof->depth].start = al_get_time();
+	}
+	prof->depth++;
+}
+
+void ProfilerEnd(struct Profiler* prof) {
+	if (!prof || !prof->depth) {
+		return;
+	}
+	prof->depth--;
+	if ((prof->depth >= PROFILER_MAX_DEPTH) || (prof->stack[prof->depth].zone < 0)) {
+		return;
+	}
+	double start = prof->stack[prof->depth].start;
+	double duration = al_get_time() - start;
+	struct ProfilerZone* zone = &prof->zones[prof->stack[prof->depth].zone];
+	zone->frame += duration;
+	if (prof->trace) {
+		TraceEvent(prof, zone->name, start, duration);
+	}
+}
+
+void ProfilerFrame(struct Profiler* prof) {
+	if (!prof) {
+		return;
+	}
+	double now = al_get_time();
+	if (prof->trace) {
+		TraceEvent(prof, "frame", prof->frame_start, now - prof->frame_start);
+	}
+	prof->frames[prof->pos] = now - prof->frame_start;
+	for (int i = 0; i < prof->zones_count; i++) {
+		prof->zones[i].history[prof->pos] = prof->zones[i].frame;
+		prof->zones[i].frame = 0;
+	}
+	prof->pos = (prof->pos + 1) % PROFILER_HISTORY;
+	if (prof->filled < PROFILER_HISTORY) {
+		prof->filled++;
+	}
+	prof->frame_start = now;
+}
+
+bool StartProfilerTrace(struct Profiler* prof, const char* filename) {
+	StopProfilerTrace(prof);
+	prof->trace = fopen(filename, "w");
+	if (!prof->trace) {
+		return false;
+	}
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", prof->trace);
+	prof->trace_start = al_get_time();
+	prof->trace_empty = true;
+	return true;
+}
+
+void StopProfilerTrace(struct Profiler* prof) {
+	if (!prof->trace) {
+		return;
+	}
+	fputs("\n]}\n", prof->trace);
+	fclose(prof->trace);
+	prof->trace = NULL;
+}
+
+static int CompareDoubles(const void* a, const void* b) {
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+struct Stats {
+	double avg, p50, p95, p99, max;
+};
+
+// Nearest-rank percentiles over the recorded part of the history.
+static struct Stats GetStats(const double* history, int count) {
+	double sorted[PROFILER_HISTORY];
+	struct Stats stats = {0};
+	if (!count) {
+		return stats;
+	}
+	memcpy(sorted, history, sizeof(double) * count);
+	qsort(sorted, count, sizeof(double), CompareDoubles);
+	for (int i = 0; i < count; i++) {
+		stats.avg += sorted[i];
+	}
+	stats.avg /= count;
+	stats.p50 = sorted[(int)ceil(0.50 * count) - 1];
+	stats.p95 = sorted[(int)ceil(0.95 * count) - 1];
+	stats.p99 = sorted[(int)ceil(0.99 * count) - 1];
+	stats.max = sorted[count - 1];
+	return stats;
+}
+
+static void DrawStats(struct Profiler* prof, float y, const char* name, struct Stats stats, ALLEGRO_COLOR color) {
+	al_draw_textf(prof->font, color, 4, y, ALLEGRO_ALIGN_LEFT, "%-14.14s %6.2f %6.2f %6.2f %6.2f %6.2f",
+		name, stats.avg * 1000, stats.p50 * 1000, stats.p95 * 1000, stats.p99 * 1000, stats.max * 1000);
+}
+
+void DrawProfiler(struct Profiler* prof) {
+	if (!prof || !prof->overlay) {
+		return;
+	}
+	if (!prof->font) {
+		prof->font = al_create_builtin_font();
+		if (!prof->font) {
+			return;
+		}
+	}
+
+	int rows = 2 + prof->zones_count;
+	float line = al_get_font_line_height(prof->font) + 2;
+	float graph = 48;
+	float width = 4 + 44 * al_get_text_width(prof->font, " ") + 4;
+	float height = 4 + rows * line + graph + 4;
+	al_draw_filled_rectangle(0, 0, width, height, al_premul_rgba(0, 0, 0, 192));
+
+	ALLEGRO_COLOR white = al_map_rgb(255, 255, 255), grey = al_map_rgb(160, 160, 160), red = al_map_rgb(255, 64, 64);
+	al_draw_textf(prof->font, prof->trace ? red : grey, 4, 4, ALLEGRO_ALIGN_LEFT, "%-14s %6s %6s %6s %6s %6s",
+		prof->trace ? "ms (tracing)" : "ms", "avg", "p50", "p95", "p99", "max");
+
+	// history is a ring buffer, but the order doesn't matter for the statistics
+	struct Stats frame = GetStats(prof->frames, prof->filled);
+	DrawStats(prof, 4 + line, "frame", frame, frame.p95 > PROFILER_BUDGET ? red : white);
+	float y = 4 + 2 * line;
+	for (int i = 0; i < prof->zones_count; i++) {
+		struct Stats stats = GetStats(prof->zones[i].history, prof->filled);
+		DrawStats(prof, y, prof->zones[i].name, stats, stats.max > 0 ? white : grey);
+		y += line;
+	}
+
+	// frame times, oldest on the left; the line marks the frame budget at half the graph height
+	float scale = graph / 2 / PROFILER_BUDGET, bar = (width - 8) / PROFILER_HISTORY;
+	float bottom = y + graph;
+	for (int i = 0; i < prof->filled; i++) {
+		double t = prof->frames[(prof->pos - prof->filled + i + PROFILER_HISTORY) % PROFILER_HISTORY];
+		float x = 4 + i * bar;
+		al_draw_filled_rectangle(x, bottom - fmin(t * scale, graph), x + bar, bottom, t > PROFILER_BUDGET ? red : grey);
+	}
+	al_draw_line(4, bottom - graph / 2, width - 4, bottom - graph / 2, white, 1);
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZENEKGIENEK_PROFILER_H
+#define ZENEKGIENEK_PROFILER_H
+
+#include <libsuperderpy.h>
+#include <stdio.h>
+
+// Measures how long named phases of a frame take. Zones are opened and closed
+// with ProfilerBegin/ProfilerEnd (they may nest) and their times are summed up
+// per frame, so a phase that runs more than once in a frame (like logic
+// catching up) counts as a whole. Keeps the last PROFILER_HISTORY frames for
+// the overlay and can additionally stream every zone into a Chrome trace file
+// (chrome://tracing, Perfetto). Must be used from the main thread only.
+
+#define PROFILER_HISTORY 240
+#define PROFILER_MAX_ZONES 32
+#define PROFILER_MAX_DEPTH 16
+#define PROFILER_BUDGET (1.0 / 60)
+
+struct ProfilerZone {
+	const char* name;
+	double frame; // time spent in this zone during the current frame
+	double history[PROFILER_HISTORY];
+};
+
+struct Profiler {
+	struct ProfilerZone zones[PROFILER_MAX_ZONES];
+	int zones_count;
+
+	struct {
+		int zone;
+		double start;
+	} stack[PROFILER_MAX_DEPTH];
+	int depth;
+
+	double frame_start;
+	double frames[PROFILER_HISTORY];
+	int pos, filled;
+
+	bool overlay;
+	ALLEGRO_FONT* font;
+
+	FILE* trace;
+	double trace_start;
+	bool trace_empty;
+};
+
+struct Profiler* CreateProfiler(void);
+void DestroyProfiler(struct Profiler* prof);
+// Both accept NULL, so callers don't have to care whether profiling is available.
+void ProfilerBegin(struct Profiler* prof, const char* name);
+void ProfilerEnd(struct Profiler* prof);
+// Closes the current frame; call once per displayed frame.
+void ProfilerFrame(struct Profiler* prof);
+// Draws the overlay (if enabled) onto the current target in its pixel coordinates.
+void DrawProfiler(struct Profiler* prof);
+bool StartProfilerTrace(struct Profiler* prof, const char* filename);
+void StopProfilerTrace(struct Profiler* prof);
+
+#endif
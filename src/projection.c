@@ -0,0 +1,131 @@
+/*! \file projection.c
+ *  \brief Coordinate transformations shared by rendering and benchmarks.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "projection.h"
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PROJECTION_SSE2
+#endif
+
+void TransformCoordinates4D(const float m[4][4], float* x, float* y, float* z, float* w) {
+	float rx, ry, rz, rw;
+
+	rx = m[0][0] * *x + m[1][0] * *y + m[2][0] * *z + m[3][0] * *w;
+	ry = m[0][1] * *x + m[1][1] * *y + m[2][1] * *z + m[3][1] * *w;
+	rz = m[0][2] * *x + m[1][2] * *y + m[2][2] * *z + m[3][2] * *w;
+	rw = m[0][3] * *x + m[1][3] * *y + m[2][3] * *z + m[3][3] * *w;
+
+	*x = rx;
+	*y = ry;
+	*z = rz;
+	*w = rw;
+}
+
+void TransformCoordinates3DProjective(const float m[4][4], float* x, float* y, float* z) {
+	float w = 1;
+	TransformCoordinates4D(m, x, y, z, &w);
+	*x /= w;
+	*y /= w;
+	*z /= w;
+}
+
+bool UnprojectToGround(const float m[4][4], float ndc_x, float ndc_y, float* x, float* y) {
+	// with z = 0, ndc_x * w = rx and ndc_y * w = ry make a pair of linear equations
+	float a = m[0][0] - ndc_x * m[0][3], b = m[1][0] - ndc_x * m[1][3], e = ndc_x * m[3][3] - m[3][0];
+	float c = m[0][1] - ndc_y * m[0][3], d = m[1][1] - ndc_y * m[1][3], f = ndc_y * m[3][3] - m[3][1];
+	float det = a * d - b * c;
+	if (fabsf(det) < 1e-12f) {
+		return false;
+	}
+	float rx = (e * d - b * f) / det, ry = (a * f - e * c) / det;
+	if (m[0][3] * rx + m[1][3] * ry + m[3][3] <= 0) {
+		return false;
+	}
+	*x = rx;
+	*y = ry;
+	return true;
+}
+
+static int ProjectGroundPointsScalar(const float m[4][4], const double* x, const double* y, int start, int count,
+	float width, float height, float margin, float* sx, float* sy, float* sz, int* visible) {
+	int n = 0;
+	for (int i = start; i < count; i++) {
+		float px = x[i], py = y[i];
+		// z is 0 and w is 1, so the third row drops out entirely
+		float rx = m[0][0] * px + m[1][0] * py + m[3][0];
+		float ry = m[0][1] * px + m[1][1] * py + m[3][1];
+		float rz = m[0][2] * px + m[1][2] * py + m[3][2];
+		float rw = m[0][3] * px + m[1][3] * py + m[3][3];
+		sx[i] = rx / rw * (width / 2) + width / 2;
+		sy[i] = ry / rw * (-height / 2) + height / 2;
+		sz[i] = rz / rw;
+		if ((rw > 0) && (sx[i] >= -margin) && (sx[i] <= width + margin) && (sy[i] >= -margin) && (sy[i] <= height + margin)) {
+			visible[n++] = i;
+		}
+	}
+	return n;
+}
+
+int ProjectGroundPoints(const float m[4][4], const double* x, const double* y, int count,
+	float width, float height, float margin, float* sx, float* sy, float* sz, int* visible) {
+	int i = 0, n = 0;
+#ifdef PROJECTION_SSE2
+	__m128 m00 = _mm_set1_ps(m[0][0]), m10 = _mm_set1_ps(m[1][0]), m30 = _mm_set1_ps(m[3][0]);
+	__m128 m01 = _mm_set1_ps(m[0][1]), m11 = _mm_set1_ps(m[1][1]), m31 = _mm_set1_ps(m[3][1]);
+	__m128 m02 = _mm_set1_ps(m[0][2]), m12 = _mm_set1_ps(m[1][2]), m32 = _mm_set1_ps(m[3][2]);
+	__m128 m03 = _mm_set1_ps(m[0][3]), m13 = _mm_set1_ps(m[1][3]), m33 = _mm_set1_ps(m[3][3]);
+	__m128 half_w = _mm_set1_ps(width / 2), half_h = _mm_set1_ps(height / 2), neg_half_h = _mm_set1_ps(-height / 2);
+	__m128 min = _mm_set1_ps(-margin), max_x = _mm_set1_ps(width + margin), max_y = _mm_set1_ps(height + margin);
+	__m128 zero = _mm_setzero_ps();
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 px = _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(x + i)), _mm_cvtpd_ps(_mm_loadu_pd(x + i + 2)));
+		__m128 py = _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(y + i)), _mm_cvtpd_ps(_mm_loadu_pd(y + i + 2)));
+
+		__m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, px), _mm_mul_ps(m10, py)), m30);
+		__m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m01, px), _mm_mul_ps(m11, py)), m31);
+		__m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m02, px), _mm_mul_ps(m12, py)), m32);
+		__m128 rw = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m03, px), _mm_mul_ps(m13, py)), m33);
+
+		__m128 vx = _mm_add_ps(_mm_mul_ps(_mm_div_ps(rx, rw), half_w), half_w);
+		__m128 vy = _mm_add_ps(_mm_mul_ps(_mm_div_ps(ry, rw), neg_half_h), half_h);
+		_mm_storeu_ps(sx + i, vx);
+		_mm_storeu_ps(sy + i, vy);
+		_mm_storeu_ps(sz + i, _mm_div_ps(rz, rw));
+
+		__m128 inside = _mm_and_ps(_mm_cmpgt_ps(rw, zero),
+			_mm_and_ps(_mm_and_ps(_mm_cmpge_ps(vx, min), _mm_cmple_ps(vx, max_x)),
+				_mm_and_ps(_mm_cmpge_ps(vy, min), _mm_cmple_ps(vy, max_y))));
+		int mask = _mm_movemask_ps(inside);
+		// branchless compaction of the visible lanes
+		visible[n] = i;
+		n += mask & 1;
+		visible[n] = i + 1;
+		n += (mask >> 1) & 1;
+		visible[n] = i + 2;
+		n += (mask >> 2) & 1;
+		visible[n] = i + 3;
+		n += (mask >> 3) & 1;
+	}
+#endif
+	return n + ProjectGroundPointsScalar(m, x, y, i, count, width, height, margin, sx, sy, sz, visible + n);
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZENEKGIENEK_PROJECTION_H
+#define ZENEKGIENEK_PROJECTION_H
+
+#include <stdbool.h>
+
+// Matrix math behind al_transform_coordinates_3d_projective, operating on the
+// plain m[4][4] array of an ALLEGRO_TRANSFORM so it can be used (and measured)
+// without Allegro.
+
+void TransformCoordinates4D(const float m[4][4], float* x, float* y, float* z, float* w);
+void TransformCoordinates3DProjective(const float m[4][4], float* x, float* y, float* z);
+
+// Finds the point on the z = 0 plane that ends up at given normalized device
+// coordinates. Returns false when no such point lies in front of the camera
+// (e.g. when looking above the horizon).
+bool UnprojectToGround(const float m[4][4], float ndc_x, float ndc_y, float* x, float* y);
+
+// Projects count points lying on the z = 0 plane into screen coordinates of a
+// width x height viewport, writing them to sx, sy and the depth (as given by
+// TransformCoordinates3DProjective) to sz. Indices of points that are in front
+// of the camera and no further than margin away from the viewport are written
+// to visible (which needs room for count of them); their number is returned.
+int ProjectGroundPoints(const float m[4][4], const double* x, const double* y, int count,
+	float width, float height, float margin, float* sx, float* sy, float* sz, int* visible);
+
+#endif
@@ -0,0 +1,184 @@
+/*! \file replay.c
+ *  \brief Recording and playback of input.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay.h"
+#include "snapshot.h"
+#include <stdlib.h>
+#include <string.h>
+
+// the most bytes a single event can take: 5 for the tick, 1, 5 for the argument
+#define MAX_EVENT_SIZE 11
+
+static size_t PutVarint(uint8_t* out, uint32_t value) {
+	size_t n = 0;
+	while (value >= 0x80) {
+		out[n++] = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+	out[n++] = value;
+	return n;
+}
+
+static bool GetVarint(const uint8_t** in, const uint8_t* end, uint32_t* value) {
+	*value = 0;
+	for (int shift = 0; (shift < 35) && (*in < end); shift += 7) {
+		uint8_t byte = *(*in)++;
+		*value |= (uint32_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+struct Replay* CreateReplay(uint64_t seed) {
+	struct Replay* replay = calloc(1, sizeof(struct Replay));
+	replay->seed = seed;
+	return replay;
+}
+
+void DestroyReplay(struct Replay* replay) {
+	free(replay->events);
+	free(replay);
+}
+
+void RecordReplayEvent(struct Replay* replay, int tick, enum REPLAY_EVENT kind, int code, int arg) {
+	if (replay->events_count == replay->events_capacity) {
+		int capacity = replay->events_capacity ? replay->events_capacity * 2 : 256;
+		struct ReplayEvent* events = realloc(replay->events, sizeof(struct ReplayEvent) * capacity);
+		if (!events) {
+			return;
+		}
+		replay->events = events;
+		replay->events_capacity = capacity;
+	}
+	replay->events[replay->events_count++] = (struct ReplayEvent){.tick = tick, .kind = kind, .code = code, .arg = arg};
+	if (tick > replay->ticks) {
+		replay->ticks = tick;
+	}
+}
+
+bool SaveReplay(const struct Replay* replay, const char* path) {
+	size_t size = sizeof(struct ReplayHeader) + (size_t)replay->events_count * MAX_EVENT_SIZE;
+	uint8_t* buffer = malloc(size);
+	if (!buffer) {
+		return false;
+	}
+
+	uint8_t* out = buffer + sizeof(struct ReplayHeader);
+	int tick = 0;
+	for (int i = 0; i < replay->events_count; i++) {
+		const struct ReplayEvent* event = &replay->events[i];
+		out += PutVarint(out, event->tick - tick);
+		*out++ = (event->kind << 5) | (event->code & 0x1F);
+		if (event->kind == REPLAY_COMMAND) {
+			out += PutVarint(out, ((uint32_t)event->arg << 1) ^ (uint32_t)(event->arg >> 31));
+		}
+		tick = event->tick;
+	}
+
+	struct ReplayHeader header = {
+		.magic = REPLAY_MAGIC,
+		.version = REPLAY_VERSION,
+		.events = replay->events_count,
+		.seed = replay->seed,
+		.ticks = replay->ticks,
+		.data_size = out - buffer - sizeof(struct ReplayHeader),
+		.endless = replay->endless,
+	};
+	memcpy(buffer, &header, sizeof(header));
+	bool ok = WriteSnapshotFile(path, buffer, out - buffer);
+	free(buffer);
+	return ok;
+}
+
+struct Replay* LoadReplay(const char* path) {
+	size_t size = 0;
+	uint8_t* buffer = ReadSnapshotFile(path, &size);
+	if (!buffer) {
+		return NULL;
+	}
+	struct ReplayHeader header = {0};
+	if (size >= sizeof(header)) {
+		memcpy(&header, buffer, sizeof(header));
+	}
+	if ((memcmp(header.magic, REPLAY_MAGIC, sizeof(header.magic)) != 0) || (header.version != REPLAY_VERSION) ||
+		(header.data_size != size - sizeof(header)) || (header.events > header.data_size / 2)) {
+		free(buffer);
+		return NULL;
+	}
+
+	struct Replay* replay = CreateReplay(header.seed);
+	replay->endless = header.endless;
+	const uint8_t* in = buffer + sizeof(header);
+	const uint8_t* end = buffer + size;
+	uint32_t tick = 0;
+	bool ok = true;
+	for (uint32_t i = 0; (i < header.events) && ok; i++) {
+		uint32_t delta, arg = 0;
+		ok = GetVarint(&in, end, &delta) && (in < end) && (delta <= INT32_MAX - tick);
+		if (!ok) {
+			break;
+		}
+		tick += delta;
+		uint8_t byte = *in++;
+		enum REPLAY_EVENT kind = byte >> 5;
+		if (kind == REPLAY_COMMAND) {
+			ok = GetVarint(&in, end, &arg);
+		} else if (kind > REPLAY_COMMAND) {
+			ok = false;
+		}
+		if (ok) {
+			RecordReplayEvent(replay, tick, kind, byte & 0x1F, (int32_t)((arg >> 1) ^ -(arg & 1)));
+			ok = replay->events_count == (int)i + 1;
+		}
+	}
+	free(buffer);
+	if (!ok || (in != end)) {
+		DestroyReplay(replay);
+		return NULL;
+	}
+	if (header.ticks > (uint32_t)replay->ticks) {
+		replay->ticks = header.ticks;
+	}
+	return replay;
+}
+
+const struct ReplayEvent* NextReplayEvent(struct Replay* replay, int tick) {
+	if ((replay->pos < replay->events_count) && (replay->events[replay->pos].tick <= tick)) {
+		return &replay->events[replay->pos++];
+	}
+	return NULL;
+}
+
+int GetReplayKeyInput(enum REPLAY_KEY key) {
+	switch (key) {
+		case REPLAY_KEY_LEFT:
+			return SIM_INPUT_LEFT;
+		case REPLAY_KEY_RIGHT:
+			return SIM_INPUT_RIGHT;
+		case REPLAY_KEY_UP:
+			return SIM_INPUT_UP;
+		case REPLAY_KEY_DOWN:
+			return SIM_INPUT_DOWN;
+		default:
+			return 0;
+	}
+}
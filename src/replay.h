@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZENEKGIENEK_REPLAY_H
+#define ZENEKGIENEK_REPLAY_H
+
+#include "sim.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Recording of a play session: the sim seed and flags, every key the gameplay reacts
+// to and the commands the intro gave to the sim, each with the tick it took
+// effect at (the number of ticks run before it). Fed back from the same seed,
+// it plays out exactly the same, both in game and in the headless runner.
+//
+// File layout: ReplayHeader, then `data_size` bytes of events, each being a
+// varint tick delta since the previous event, a byte with the kind in the top
+// three bits and the key or command type in the rest, and for commands the
+// zigzag varint argument.
+
+#define REPLAY_MAGIC "ZGRPLv2"
+#define REPLAY_VERSION 2
+
+enum REPLAY_EVENT {
+	REPLAY_PRESS,
+	REPLAY_RELEASE,
+	REPLAY_COMMAND // given by the game itself rather than the player
+};
+
+enum REPLAY_KEY {
+	REPLAY_KEY_LEFT,
+	REPLAY_KEY_RIGHT,
+	REPLAY_KEY_UP,
+	REPLAY_KEY_DOWN,
+	REPLAY_KEY_SPACE,
+	REPLAY_KEY_FULLSTOP,
+	REPLAY_KEY_ESCAPE
+};
+
+struct ReplayHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t events;
+	uint64_t seed;
+	uint32_t ticks; // length of the whole recording
+	uint32_t data_size;
+	uint8_t endless; // the sim's, it has to be the same on playback
+	uint8_t reserved[7];
+};
+
+struct ReplayEvent {
+	int tick;
+	enum REPLAY_EVENT kind;
+	int code; // REPLAY_KEY or SIM_COMMAND_TYPE
+	int arg;
+};
+
+struct Replay {
+	uint64_t seed;
+	bool endless;
+	int ticks;
+	struct ReplayEvent* events;
+	int events_count, events_capacity;
+	int pos; // next event to be played
+};
+
+struct Replay* CreateReplay(uint64_t seed);
+void DestroyReplay(struct Replay* replay);
+// Events have to be recorded in order of their ticks; the length of the
+// recording is extended up to the last one.
+void RecordReplayEvent(struct Replay* replay, int tick, enum REPLAY_EVENT kind, int code, int arg);
+bool SaveReplay(const struct Replay* replay, const char* path);
+// Returns NULL when the file can't be read or isn't a valid replay.
+struct Replay* LoadReplay(const char* path);
+// Returns the next event that takes effect at the given tick or before, or NULL.
+const struct ReplayEvent* NextReplayEvent(struct Replay* replay, int tick);
+// SIM_INPUT_* bit held by the key, or 0.
+int GetReplayKeyInput(enum REPLAY_KEY key);
+
+#endif
@@ -0,0 +1,310 @@
+/*! \file script.c
+ *  \brief Cutscene script compiler and loader.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "script.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCRIPT_MAX_TOKENS 5
+
+static uint64_t HashSource(const char* source, size_t size) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= (unsigned char)source[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static char* ReadWholeFile(const char* path, size_t* size) {
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		return NULL;
+	}
+	char* data = NULL;
+	long length = -1;
+	if (fseek(file, 0, SEEK_END) == 0) {
+		length = ftell(file);
+	}
+	if ((length >= 0) && (fseek(file, 0, SEEK_SET) == 0)) {
+		data = malloc(length + 1);
+		if (data && (fread(data, 1, length, file) == (size_t)length)) {
+			data[length] = '\0';
+			*size = length;
+		} else {
+			free(data);
+			data = NULL;
+		}
+	}
+	fclose(file);
+	return data;
+}
+
+const char* GetScriptString(struct Script* script, uint32_t id) {
+	return script->strings + script->offsets[id];
+}
+
+// Returns the id of given string, adding it to the table if it's not there yet.
+static uint32_t AddString(struct Script* script, const char* str) {
+	for (int i = 0; i < script->strings_count; i++) {
+		if (strcmp(GetScriptString(script, i), str) == 0) {
+			return i;
+		}
+	}
+	size_t length = strlen(str) + 1;
+	script->strings = realloc(script->strings, script->strings_size + length);
+	script->offsets = realloc(script->offsets, sizeof(uint32_t) * (script->strings_count + 1));
+	memcpy(script->strings + script->strings_size, str, length);
+	script->offsets[script->strings_count] = script->strings_size;
+	script->strings_size += length;
+	return script->strings_count++;
+}
+
+static void AddStep(struct Script* script, struct ScriptStep step) {
+	script->steps = realloc(script->steps, sizeof(struct ScriptStep) * (script->steps_count + 1));
+	script->steps[script->steps_count++] = step;
+}
+
+// Splits a line into tokens in place. Tokens are separated by whitespace,
+// unless they're in double quotes (where \" and \\ can be used); # starts a comment.
+static int Tokenize(char* line, char** tokens, bool* error) {
+	int count = 0;
+	char* p = line;
+	while (*p) {
+		while ((*p == ' ') || (*p == '\t') || (*p == '\r')) {
+			p++;
+		}
+		if (!*p || (*p == '#')) {
+			break;
+		}
+		if (count == SCRIPT_MAX_TOKENS) {
+			*error = true;
+			break;
+		}
+		if (*p == '"') {
+			char* out = ++p;
+			tokens[count++] = out;
+			while (*p && (*p != '"')) {
+				if ((*p == '\\') && p[1]) {
+					p++;
+				}
+				*out++ = *p++;
+			}
+			if (*p != '"') {
+				*error = true;
+				break;
+			}
+			p++;
+			*out = '\0';
+		} else {
+			tokens[count++] = p;
+			while (*p && (*p != ' ') && (*p != '\t') && (*p != '\r')) {
+				p++;
+			}
+			if (*p) {
+				*p++ = '\0';
+			}
+		}
+	}
+	return count;
+}
+
+struct Script* CompileScript(const char* source, size_t size, const char* filename) {
+	struct Script* script = calloc(1, sizeof(struct Script));
+	script->source_hash = HashSource(source, size);
+	bool failed = false;
+
+	const char* end = source + size;
+	int n = 0;
+	for (const char* p = source; p < end; n++) {
+		const char* eol = memchr(p, '\n', end - p);
+		if (!eol) {
+			eol = end;
+		}
+		char* line = malloc(eol - p + 1);
+		memcpy(line, p, eol - p);
+		line[eol - p] = '\0';
+		p = eol + 1;
+
+		char* tokens[SCRIPT_MAX_TOKENS];
+		bool error = false;
+		int count = Tokenize(line, tokens, &error);
+		if (error) {
+			fprintf(stderr, "%s:%d: can't parse line\n", filename, n + 1);
+			failed = true;
+		} else if (count == 0) {
+			// empty line or comment
+		} else if (strcmp(tokens[0], "delay") == 0) {
+			char* num_end = NULL;
+			double delay = (count == 2) ? strtod(tokens[1], &num_end) : -1;
+			if ((count != 2) || *num_end || (delay < 0)) {
+				fprintf(stderr, "%s:%d: expected \"delay <seconds>\"\n", filename, n + 1);
+				failed = true;
+			} else {
+				AddStep(script, (struct ScriptStep){.op = SCRIPT_DELAY, .delay = delay});
+			}
+		} else if (strcmp(tokens[0], "speak") == 0) {
+			if (count != 4) {
+				fprintf(stderr, "%s:%d: expected \"speak <voice file> <person> <subtitle>\"\n", filename, n + 1);
+				failed = true;
+			} else {
+				AddStep(script, (struct ScriptStep){.op = SCRIPT_SPEAK, .voice = AddString(script, tokens[1]), .person = AddString(script, tokens[2]), .subtitle = AddString(script, tokens[3])});
+			}
+		} else if (count <= 2) {
+			AddStep(script, (struct ScriptStep){.op = SCRIPT_ACTION, .action = AddString(script, tokens[0]), .arg = (count == 2) ? AddString(script, tokens[1]) : SCRIPT_NO_ARG});
+		} else {
+			fprintf(stderr, "%s:%d: unexpected arguments to action \"%s\"\n", filename, n + 1, tokens[0]);
+			failed = true;
+		}
+		free(line);
+	}
+
+	if (failed) {
+		DestroyScript(script);
+		return NULL;
+	}
+	return script;
+}
+
+static bool Validate(struct Script* script) {
+	if (script->strings_size && (script->strings[script->strings_size - 1] != '\0')) {
+		return false;
+	}
+	for (int i = 0; i < script->strings_count; i++) {
+		if (script->offsets[i] >= script->strings_size) {
+			return false;
+		}
+	}
+	for (int i = 0; i < script->steps_count; i++) {
+		struct ScriptStep* step = &script->steps[i];
+		uint32_t max = script->strings_count;
+		switch (step->op) {
+			case SCRIPT_DELAY:
+				if (!(step->delay >= 0)) {
+					return false;
+				}
+				break;
+			case SCRIPT_SPEAK:
+				if ((step->voice >= max) || (step->person >= max) || (step->subtitle >= max)) {
+					return false;
+				}
+				break;
+			case SCRIPT_ACTION:
+				if ((step->action >= max) || ((step->arg >= max) && (step->arg != SCRIPT_NO_ARG))) {
+					return false;
+				}
+				break;
+			default:
+				return false;
+		}
+	}
+	return true;
+}
+
+struct Script* LoadScriptTable(const char* path) {
+	size_t size = 0;
+	char* data = ReadWholeFile(path, &size);
+	if (!data) {
+		return NULL;
+	}
+	struct ScriptHeader header;
+	if (size < sizeof(header)) {
+		free(data);
+		return NULL;
+	}
+	memcpy(&header, data, sizeof(header));
+	uint64_t expected = sizeof(header) + (uint64_t)header.steps * sizeof(struct ScriptStep) + (uint64_t)header.strings * sizeof(uint32_t) + header.strings_size;
+	if ((memcmp(header.magic, SCRIPT_MAGIC, sizeof(header.magic)) != 0) || (header.version != SCRIPT_VERSION) || (expected != size)) {
+		free(data);
+		return NULL;
+	}
+
+	struct Script* script = calloc(1, sizeof(struct Script));
+	script->source_hash = header.source_hash;
+	script->steps_count = header.steps;
+	script->strings_count = header.strings;
+	script->strings_size = header.strings_size;
+	script->steps = malloc(sizeof(struct ScriptStep) * header.steps);
+	script->offsets = malloc(sizeof(uint32_t) * header.strings);
+	script->strings = malloc(header.strings_size);
+	const char* p = data + sizeof(header);
+	memcpy(script->steps, p, sizeof(struct ScriptStep) * header.steps);
+	p += sizeof(struct ScriptStep) * header.steps;
+	memcpy(script->offsets, p, sizeof(uint32_t) * header.strings);
+	p += sizeof(uint32_t) * header.strings;
+	memcpy(script->strings, p, header.strings_size);
+	free(data);
+
+	if (!Validate(script)) {
+		DestroyScript(script);
+		return NULL;
+	}
+	return script;
+}
+
+bool SaveScriptTable(struct Script* script, const char* path) {
+	FILE* file = fopen(path, "wb");
+	if (!file) {
+		return false;
+	}
+	struct ScriptHeader header = {
+		.magic = SCRIPT_MAGIC,
+		.version = SCRIPT_VERSION,
+		.steps = script->steps_count,
+		.strings = script->strings_count,
+		.strings_size = script->strings_size,
+		.source_hash = script->source_hash,
+	};
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = ok && (fwrite(script->steps, sizeof(struct ScriptStep), script->steps_count, file) == (size_t)script->steps_count);
+	ok = ok && (fwrite(script->offsets, sizeof(uint32_t), script->strings_count, file) == (size_t)script->strings_count);
+	ok = ok && (fwrite(script->strings, 1, script->strings_size, file) == script->strings_size);
+	return (fclose(file) == 0) && ok;
+}
+
+struct Script* LoadScript(const char* source_path, const char* table_path) {
+	size_t size = 0;
+	char* source = source_path ? ReadWholeFile(source_path, &size) : NULL;
+	if (table_path) {
+		struct Script* script = LoadScriptTable(table_path);
+		if (script && (!source || (script->source_hash == HashSource(source, size)))) {
+			free(source);
+			return script;
+		}
+		DestroyScript(script);
+	}
+	if (!source) {
+		return NULL;
+	}
+	struct Script* script = CompileScript(source, size, source_path);
+	free(source);
+	return script;
+}
+
+void DestroyScript(struct Script* script) {
+	if (!script) {
+		return;
+	}
+	free(script->steps);
+	free(script->offsets);
+	free(script->strings);
+	free(script);
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZENEKGIENEK_SCRIPT_H
+#define ZENEKGIENEK_SCRIPT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Cutscene scripts: a list of delays, voice lines and named actions. They're
+// written as text (see data/scripts/intro.txt) and compiled by
+// zenekgienek_scriptc into a binary table, in which every string - voice file,
+// speaker and subtitle - is stored once and referred to by its id.
+// Doesn't depend on Allegro, so the compiler doesn't have to either.
+//
+// Table layout: ScriptHeader, `steps` ScriptStep records, `strings` uint32_t
+// offsets into the string data, then `strings_size` bytes of NUL-terminated strings.
+
+#define SCRIPT_MAGIC "ZGSCRv1"
+#define SCRIPT_VERSION 1
+#define SCRIPT_NO_ARG UINT32_MAX
+
+enum SCRIPT_OP {
+	SCRIPT_DELAY,
+	SCRIPT_SPEAK,
+	SCRIPT_ACTION
+};
+
+struct ScriptHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t steps, strings, strings_size;
+	uint64_t source_hash; // of the text it was compiled from
+};
+
+struct ScriptStep {
+	uint32_t op;
+	float delay; // SCRIPT_DELAY, in seconds
+	uint32_t action, arg; // SCRIPT_ACTION, name and an optional argument
+	uint32_t voice, person, subtitle; // SCRIPT_SPEAK
+};
+
+struct Script {
+	struct ScriptStep* steps;
+	int steps_count;
+	uint32_t* offsets;
+	int strings_count;
+	char* strings;
+	size_t strings_size;
+	uint64_t source_hash;
+};
+
+// Errors are reported on stderr as filename:line; returns NULL if there were any.
+struct Script* CompileScript(const char* source, size_t size, const char* filename);
+struct Script* LoadScriptTable(const char* path);
+bool SaveScriptTable(struct Script* script, const char* path);
+// Uses the compiled table unless it's missing or was compiled from a different
+// version of the source; then the source is compiled on the spot. Either path may be NULL.
+struct Script* LoadScript(const char* source_path, const char* table_path);
+void DestroyScript(struct Script* script);
+const char* GetScriptString(struct Script* script, uint32_t id);
+
+#endif
@@ -0,0 +1,44 @@
+/*! \file scriptc.c
+ *  \brief Compiles cutscene scripts into binary tables.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "script.h"
+#include <stdio.h>
+
+int main(int argc, char** argv) {
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s SOURCE OUTPUT\n", argv[0]);
+		fprintf(stderr, "Compiles a cutscene script into the table loaded by the game.\n");
+		return 1;
+	}
+	// compile the source even if there's an up-to-date table already
+	struct Script* script = LoadScript(argv[1], NULL);
+	if (!script) {
+		fprintf(stderr, "%s: couldn't compile\n", argv[1]);
+		return 1;
+	}
+	if (!SaveScriptTable(script, argv[2])) {
+		perror(argv[2]);
+		DestroyScript(script);
+		return 1;
+	}
+	printf("%s: %d steps, %d strings\n", argv[2], script->steps_count, script->strings_count);
+	DestroyScript(script);
+	return 0;
+}
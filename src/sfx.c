@@ -0,0 +1,107 @@
+/*! \file sfx.c
+ *  \brief Sound effect voice allocation.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sfx.h"
+#include <stdlib.h>
+
+struct SfxPool* CreateSfxPool(ALLEGRO_MIXER* mixer, int voices, int max_per_frame) {
+	struct SfxPool* pool = calloc(1, sizeof(struct SfxPool));
+	pool->voices = calloc(voices, sizeof(struct SfxVoice));
+	pool->played = calloc(max_per_frame, sizeof(ALLEGRO_SAMPLE*));
+	pool->max_per_frame = max_per_frame;
+	pool->mixer = mixer;
+	for (int i = 0; i < voices; i++) {
+		ALLEGRO_SAMPLE_INSTANCE* instance = al_create_sample_instance(NULL);
+		if (!instance) {
+			break;
+		}
+		pool->voices[pool->voices_count++].instance = instance;
+	}
+	return pool;
+}
+
+void DestroySfxPool(struct SfxPool* pool) {
+	for (int i = 0; i < pool->voices_count; i++) {
+		al_destroy_sample_instance(pool->voices[i].instance);
+	}
+	free(pool->voices);
+	free(pool->played);
+	free(pool);
+}
+
+void NextSfxFrame(struct SfxPool* pool) {
+	pool->played_count = 0;
+}
+
+// How much a voice still contributes to the mix; idle voices contribute nothing.
+static float Weight(struct SfxVoice* voice) {
+	if (!voice->sample || !al_get_sample_instance_playing(voice->instance)) {
+		return 0;
+	}
+	unsigned int length = al_get_sample_instance_length(voice->instance);
+	if (!length) {
+		return 0;
+	}
+	return voice->gain * (1.0f - al_get_sample_instance_position(voice->instance) / (float)length);
+}
+
+bool PlaySfx(struct SfxPool* pool, ALLEGRO_SAMPLE* sample, float gain) {
+	if (!sample || !pool->voices_count || (pool->played_count >= pool->max_per_frame)) {
+		return false;
+	}
+	for (int i = 0; i < pool->played_count; i++) {
+		if (pool->played[i] == sample) {
+			return false;
+		}
+	}
+
+	struct SfxVoice* voice = &pool->voices[0];
+	float weight = Weight(voice);
+	for (int i = 1; (i < pool->voices_count) && (weight > 0); i++) {
+		float w = Weight(&pool->voices[i]);
+		if (w < weight) {
+			voice = &pool->voices[i];
+			weight = w;
+		}
+	}
+
+	if (voice->sample != sample) {
+		al_set_sample(voice->instance, sample);
+		al_set_sample_instance_playmode(voice->instance, ALLEGRO_PLAYMODE_ONCE);
+		if (!voice->sample) {
+			al_attach_sample_instance_to_mixer(voice->instance, pool->mixer);
+		}
+		voice->sample = sample;
+	} else {
+		al_stop_sample_instance(voice->instance);
+	}
+	al_set_sample_instance_gain(voice->instance, gain);
+	al_play_sample_instance(voice->instance);
+	voice->gain = gain;
+
+	pool->played[pool->played_count++] = sample;
+	return true;
+}
+
+void StopAllSfx(struct SfxPool* pool) {
+	for (int i = 0; i < pool->voices_count; i++) {
+		al_stop_sample_instance(pool->voices[i].instance);
+	}
+}
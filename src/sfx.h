@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZENEKGIENEK_SFX_H
+#define ZENEKGIENEK_SFX_H
+
+#include <allegro5/allegro_audio.h>
+#include <stdbool.h>
+
+// Fixed set of sample instances shared by all sound effects. When all of them
+// are busy, the one that has the least left to say (the quietest and closest
+// to its end) gets cut off. Plays are limited per frame, and the same sample
+// triggered more than once in a frame is only played once.
+
+struct SfxVoice {
+	ALLEGRO_SAMPLE_INSTANCE* instance;
+	ALLEGRO_SAMPLE* sample; // NULL until first used, as that's when it gets attached to the mixer
+	float gain;
+};
+
+struct SfxPool {
+	ALLEGRO_MIXER* mixer;
+	struct SfxVoice* voices;
+	int voices_count;
+	int max_per_frame;
+	ALLEGRO_SAMPLE** played; // this frame
+	int played_count;
+};
+
+struct SfxPool* CreateSfxPool(ALLEGRO_MIXER* mixer, int voices, int max_per_frame);
+void DestroySfxPool(struct SfxPool* pool);
+// Returns false when the sound got dropped.
+bool PlaySfx(struct SfxPool* pool, ALLEGRO_SAMPLE* sample, float gain);
+// To be called once per frame, before any PlaySfx calls for it.
+void NextSfxFrame(struct SfxPool* pool);
+void StopAllSfx(struct SfxPool* pool);
+
+#endif
@@ -0,0 +1,479 @@
+/*! \file sim.c
+ *  \brief Fixed-step gameplay simulation.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sim.h"
+#include "movement.h"
+#include <math.h>
+#include <stdlib.h>
+
+static const double PI = 3.14159265358979323846;
+
+// xorshift64*, seeded through splitmix64 so that small seeds work as well
+static uint64_t Random(struct Sim* sim) {
+	sim->rng ^= sim->rng >> 12;
+	sim->rng ^= sim->rng << 25;
+	sim->rng ^= sim->rng >> 27;
+	return sim->rng * 0x2545F4914F6CDD1DULL;
+}
+
+static int RandomInt(struct Sim* sim, int max) {
+	return (int)((Random(sim) >> 33) % max);
+}
+
+static double RandomAngle(struct Sim* sim) {
+	return (Random(sim) >> 11) * (1.0 / 9007199254740992.0) * 2 * PI;
+}
+
+// splitmix64 finalizer
+static uint64_t Mix(uint64_t z) {
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+static uint64_t SeedRandom(uint64_t seed) {
+	uint64_t z = Mix(seed + 0x9E3779B97F4A7C15ULL);
+	return z ? z : 1;
+}
+
+// Counter-based: the n-th number for a given entity doesn't depend on which
+// thread gets to it first, or on anything else drawn during the phase.
+static uint64_t RandomAt(uint64_t key, int id, int n) {
+	return Mix(key + ((uint64_t)id * 2 + n + 1) * 0x9E3779B97F4A7C15ULL);
+}
+
+struct PendingSpawn {
+	int index; // of the entity that left it behind
+	enum ENTITY_TYPE type;
+	double x, y;
+};
+
+struct SpawnBuffer {
+	struct PendingSpawn* items;
+	int count, capacity;
+	bool failed; // a spawn got dropped; jobs can't touch Sim.failed themselves
+};
+
+static void PushSpawn(struct SpawnBuffer* buffer, int index, enum ENTITY_TYPE type, double x, double y) {
+	if (buffer->count == buffer->capacity) {
+		int capacity = buffer->capacity ? buffer->capacity * 2 : 64;
+		struct PendingSpawn* items = realloc(buffer->items, sizeof(struct PendingSpawn) * capacity);
+		if (!items) {
+			buffer->failed = true;
+			return;
+		}
+		buffer->items = items;
+		buffer->capacity = capacity;
+	}
+	buffer->items[buffer->count++] = (struct PendingSpawn){.index = index, .type = type, .x = x, .y = y};
+}
+
+static int CompareSpawns(const void* a, const void* b) {
+	const struct PendingSpawn *x = a, *y = b;
+	return (x->index > y->index) - (x->index < y->index);
+}
+
+static void RunChunks(struct Sim* sim, int count, JobFunction* func, void* arg) {
+	RunJobs(sim->jobs, (count + SIM_CHUNK - 1) / SIM_CHUNK, func, arg);
+}
+
+int SimSpawn(struct Sim* sim, double x, double y, double angle, enum ENTITY_TYPE type) {
+	int id = AddEntity(sim->entities, type, x, y, angle);
+	if (id < 0) {
+		sim->failed = true;
+		return -1;
+	}
+	if ((sim->entities->id_capacity > sim->grid->capacity) && !ResizeGrid(sim->grid, sim->entities->id_capacity)) {
+		// the grid has no room for its id, so it can't stay
+		RemoveEntity(sim->entities, type, sim->entities->lists[type].count - 1);
+		sim->failed = true;
+		return -1;
+	}
+
+	if (type == TYPE_FAKE) {
+		sim->fake_counter++;
+	}
+
+	return id;
+}
+
+// Spawns an entity somewhere in a ring around the player.
+static void SpawnAround(struct Sim* sim, enum ENTITY_TYPE type) {
+	double angle = RandomAngle(sim);
+	double x = sim->x + sin(angle) * (222 + RandomInt(sim, 300));
+	double y = sim->y + cos(angle) * (222 + RandomInt(sim, 300));
+	SimSpawn(sim, x, y, RandomAngle(sim), type);
+}
+
+static void SpawnAhead(struct Sim* sim, enum ENTITY_TYPE type) {
+	SimSpawn(sim, sim->x + sin(sim->angle) * 200, sim->y + cos(sim->angle) * 200, RandomAngle(sim), type);
+}
+
+static bool IsHittable(enum ENTITY_TYPE type) {
+	return (type == TYPE_ENEMY) || (type == TYPE_USER) || (type == TYPE_MESSAGE) || (type == TYPE_FAKE);
+}
+
+static void RebuildGrid(struct Sim* sim) {
+	ClearGrid(sim->grid);
+	for (enum ENTITY_TYPE type = 0; type < TYPE_COUNT; type++) {
+		if (!IsHittable(type)) {
+			continue;
+		}
+		struct EntityList* list = &sim->entities->lists[type];
+		for (int i = 0; i < list->count; i++) {
+			GridInsert(sim->grid, list->id[i], list->x[i], list->y[i]);
+		}
+	}
+}
+
+// Returns id of a hittable entity within given distance, or -1.
+// When there's more than one, the lowest id wins, so the result doesn't
+// depend on the order of grid buckets.
+static int FindHit(struct Sim* sim, double x, double y, double dist) {
+	struct GridIterator it;
+	int hit = -1;
+	GridQueryBegin(sim->grid, &it, x - dist, y - dist, x + dist, y + dist);
+	for (int id = GridQueryNext(&it); id >= 0; id = GridQueryNext(&it)) {
+		if ((hit >= 0) && (id > hit)) {
+			continue;
+		}
+		struct EntityRef ref = sim->entities->refs[id];
+		if (IsHittable(ref.type)) {
+			struct EntityList* list = &sim->entities->lists[ref.type];
+			if ((fabs(x - list->x[ref.index]) < dist) && (fabs(y - list->y[ref.index]) < dist)) {
+				hit = id;
+			}
+		}
+	}
+	return hit;
+}
+
+static void Explode(struct Sim* sim, int id) {
+	enum ENTITY_TYPE type = sim->entities->refs[id].type;
+	int score;
+	if (type == TYPE_FAKE) {
+		sim->fake_counter--;
+		score = 100;
+	} else if (type != TYPE_ENEMY) {
+		sim->fake_counter += 2;
+		score = -500;
+	} else {
+		score = 500;
+	}
+	sim->score += score;
+
+	int i = SetEntityType(sim->entities, id, TYPE_EXPLOSION);
+	if (i >= 0) {
+		sim->entities->lists[TYPE_EXPLOSION].score[i] = score;
+		sim->entities->lists[TYPE_EXPLOSION].distance[i] = 0;
+	}
+	sim->tilt += 20;
+	sim->explosions++;
+}
+
+struct WanderJob {
+	struct Sim* sim;
+	struct EntityList* list;
+	enum ENTITY_TYPE type;
+	uint64_t key;
+};
+
+static void WanderChunk(void* arg, int job, int worker) {
+	struct WanderJob* wander = arg;
+	struct EntityList* list = wander->list;
+	struct SpawnBuffer* spawns = &wander->sim->spawns[worker];
+	int end = fmin((job + 1) * SIM_CHUNK, list->count);
+
+	for (int i = job * SIM_CHUNK; i < end; i++) {
+		if (list->distance[i] > 200) {
+			SetEntityAngle(list, i, (RandomAt(wander->key, list->id[i], 0) >> 11) * (1.0 / 9007199254740992.0) * 2 * PI);
+			list->distance[i] = 0;
+
+			if (wander->type == TYPE_ENEMY) {
+				PushSpawn(spawns, i, TYPE_FAKE, list->x[i], list->y[i]);
+			} else {
+				if ((RandomAt(wander->key, list->id[i], 1) >> 33) % 30 > 20) {
+					PushSpawn(spawns, i, TYPE_MESSAGE, list->x[i], list->y[i]);
+				}
+			}
+		}
+	}
+}
+
+static void Wander(struct Sim* sim, enum ENTITY_TYPE type) {
+	struct WanderJob wander = {.sim = sim, .list = &sim->entities->lists[type], .type = type, .key = Random(sim)};
+	int workers = sim->spawns_count - 1;
+	RunChunks(sim, wander.list->count, WanderChunk, &wander);
+
+	// Spawns are left for afterwards, so the list doesn't get reallocated
+	// underneath the jobs. Each worker collects its own; ordering them by
+	// the index of their source gives the same ids whatever the split was.
+	struct SpawnBuffer* merged = &sim->spawns[workers];
+	merged->count = 0;
+	for (int w = 0; w < workers; w++) {
+		for (int i = 0; i < sim->spawns[w].count; i++) {
+			struct PendingSpawn* spawn = &sim->spawns[w].items[i];
+			PushSpawn(merged, spawn->index, spawn->type, spawn->x, spawn->y);
+		}
+		sim->spawns[w].count = 0;
+		sim->failed = sim->failed || sim->spawns[w].failed;
+		sim->spawns[w].failed = false;
+	}
+	sim->failed = sim->failed || merged->failed;
+	merged->failed = false;
+	if (!merged->count) {
+		return;
+	}
+	qsort(merged->items, merged->count, sizeof(struct PendingSpawn), CompareSpawns);
+	for (int i = 0; i < merged->count; i++) {
+		SimSpawn(sim, merged->items[i].x, merged->items[i].y, 0, merged->items[i].type);
+	}
+}
+
+static void RunCommand(struct Sim* sim, struct SimCommand* command) {
+	switch (command->type) {
+		case SIM_COMMAND_INPUT:
+			sim->input = command->arg;
+			break;
+		case SIM_COMMAND_FIRE:
+			SimSpawn(sim, sim->x + sin(sim->angle + PI / 2) * 10, sim->y + cos(sim->angle + PI / 2) * 10, sim->angle, TYPE_BULLET);
+			sim->pew = 10;
+			break;
+		case SIM_COMMAND_START:
+			sim->started = true;
+			break;
+		case SIM_COMMAND_SPAWN_WAVE:
+			for (int i = 0; i < 32; i++) {
+				SpawnAround(sim, TYPE_USER);
+			}
+			for (int i = 0; i < 4; i++) {
+				SpawnAround(sim, TYPE_MESSAGE);
+			}
+			for (int i = 0; i < 2; i++) {
+				SpawnAround(sim, TYPE_ENEMY);
+			}
+			sim->spawning = true;
+			break;
+		case SIM_COMMAND_SPAWN_FAKE:
+			SpawnAhead(sim, TYPE_FAKE);
+			break;
+		case SIM_COMMAND_SPAWN_ENEMY:
+			SpawnAhead(sim, TYPE_ENEMY);
+			break;
+	}
+}
+
+void SetSimJobs(struct Sim* sim, struct JobPool* jobs) {
+	int count = GetJobWorkers(jobs) + 1;
+	struct SpawnBuffer* spawns = calloc(count, sizeof(struct SpawnBuffer));
+	if (!spawns) {
+		return;
+	}
+	for (int i = 0; i < sim->spawns_count; i++) {
+		free(sim->spawns[i].items);
+	}
+	free(sim->spawns);
+	sim->spawns = spawns;
+	sim->spawns_count = count;
+	sim->jobs = jobs;
+	GetMovementKernelName(); // picks the kernel now, rather than with jobs racing to do it
+}
+
+struct Sim* CreateSim(uint64_t seed) {
+	struct Sim* sim = calloc(1, sizeof(struct Sim));
+	sim->rng = SeedRandom(seed);
+	sim->entities = CreateEntityPool(1024);
+	sim->grid = CreateGrid(SIM_WORLD_SIZE, SIM_WORLD_SIZE, 32, sim->entities->id_capacity);
+	sim->x = SIM_WORLD_SIZE / 2;
+	sim->y = 3 * SIM_WORLD_SIZE / 4;
+	sim->angle = PI;
+	sim->fake_counter = 2;
+	SetSimJobs(sim, NULL);
+	return sim;
+}
+
+void DestroySim(struct Sim* sim) {
+	DestroyEntityPool(sim->entities);
+	DestroyGrid(sim->grid);
+	free(sim->commands);
+	for (int i = 0; i < sim->spawns_count; i++) {
+		free(sim->spawns[i].items);
+	}
+	free(sim->spawns);
+	free(sim);
+}
+
+void SimQueueCommand(struct Sim* sim, enum SIM_COMMAND_TYPE type, int arg) {
+	if (sim->commands_count == sim->commands_capacity) {
+		int capacity = sim->commands_capacity ? sim->commands_capacity * 2 : 16;
+		struct SimCommand* commands = realloc(sim->commands, sizeof(struct SimCommand) * capacity);
+		if (!commands) {
+			sim->failed = true;
+			return;
+		}
+		sim->commands = commands;
+		sim->commands_capacity = capacity;
+	}
+	sim->commands[sim->commands_count++] = (struct SimCommand){.type = type, .arg = arg};
+}
+
+static void AgeExplosions(void* arg, int job, int worker) {
+	struct EntityList* explosions = arg;
+	(void)worker;
+	int end = fmin((job + 1) * SIM_CHUNK, explosions->count);
+	for (int i = job * SIM_CHUNK; i < end; i++) {
+		explosions->distance[i]++;
+	}
+}
+
+bool SimBeginStep(struct Sim* sim) {
+	sim->explosions = 0;
+
+	if (sim->ended) {
+		return false;
+	}
+
+	for (int i = 0; i < sim->commands_count; i++) {
+		RunCommand(sim, &sim->commands[i]);
+	}
+	sim->commands_count = 0;
+
+	sim->tick++;
+
+	if (!sim->started) {
+		return false;
+	}
+
+	if (sim->fade < 255) {
+		sim->fade++;
+	}
+
+	if ((sim->fake_counter > SIM_MAX_FAKES) && !sim->endless) {
+		sim->ended = true;
+		return false;
+	}
+
+	if (sim->spawning && (sim->tick % SIM_TICKS_PER_SECOND == 0)) {
+		SpawnAround(sim, RandomInt(sim, 4) == 0 ? TYPE_ENEMY : TYPE_USER);
+	}
+
+	if (sim->input & SIM_INPUT_LEFT) {
+		sim->angle -= 0.02;
+	}
+
+	if (sim->input & SIM_INPUT_RIGHT) {
+		sim->angle += 0.02;
+	}
+
+	sim->x += sin(sim->angle) * 1;
+	sim->y += cos(sim->angle) * 1;
+
+	if (sim->input & SIM_INPUT_UP) {
+		sim->x += sin(sim->angle) * 1;
+		sim->y += cos(sim->angle) * 1;
+	}
+
+	if (sim->input & SIM_INPUT_DOWN) {
+		sim->x -= sin(sim->angle) * 0.5;
+		sim->y -= cos(sim->angle) * 0.5;
+	}
+
+	if (sim->pew) {
+		sim->pew--;
+	}
+
+	if (sim->tilt) {
+		sim->tilt--;
+	}
+
+	struct EntityList* explosions = &sim->entities->lists[TYPE_EXPLOSION];
+	RunChunks(sim, explosions->count, AgeExplosions, explosions);
+	// walking backwards, so the entity swapped into a removed place has been visited already
+	for (int i = explosions->count - 1; i >= 0; i--) {
+		if (explosions->distance[i] > 16) {
+			RemoveEntity(sim->entities, TYPE_EXPLOSION, i);
+		}
+	}
+
+	return true;
+}
+
+struct MoveJob {
+	struct EntityList* list;
+	double step;
+};
+
+static void MoveChunk(void* arg, int job, int worker) {
+	struct MoveJob* move = arg;
+	(void)worker;
+	struct EntityList* list = move->list;
+	int begin = job * SIM_CHUNK;
+	int count = fmin(SIM_CHUNK, list->count - begin);
+	MoveEntities(list->x + begin, list->y + begin, list->distance + begin, list->dx + begin, list->dy + begin, move->step, count);
+}
+
+static void MoveList(struct Sim* sim, enum ENTITY_TYPE type, double step) {
+	struct MoveJob move = {.list = &sim->entities->lists[type], .step = step};
+	RunChunks(sim, move.list->count, MoveChunk, &move);
+}
+
+void SimMoveBullets(struct Sim* sim) {
+	MoveList(sim, TYPE_BULLET, 5);
+}
+
+void SimMoveWanderers(struct Sim* sim) {
+	MoveList(sim, TYPE_USER, 0.5);
+	MoveList(sim, TYPE_ENEMY, 0.5);
+}
+
+void SimCollide(struct Sim* sim) {
+	RebuildGrid(sim);
+
+	int hit = FindHit(sim, sim->x, sim->y, 12);
+	if (hit >= 0) {
+		Explode(sim, hit);
+	}
+
+	struct EntityList* bullets = &sim->entities->lists[TYPE_BULLET];
+	for (int i = bullets->count - 1; i >= 0; i--) {
+		hit = FindHit(sim, bullets->x[i], bullets->y[i], 8);
+		if (hit >= 0) {
+			Explode(sim, hit);
+		}
+		if ((hit >= 0) || (bullets->distance[i] > 300)) {
+			RemoveEntity(sim->entities, TYPE_BULLET, i);
+		}
+	}
+}
+
+void SimWander(struct Sim* sim) {
+	Wander(sim, TYPE_USER);
+	Wander(sim, TYPE_ENEMY);
+}
+
+void SimStep(struct Sim* sim) {
+	if (!SimBeginStep(sim)) {
+		return;
+	}
+	SimMoveBullets(sim);
+	SimCollide(sim);
+	SimMoveWanderers(sim);
+	SimWander(sim);
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZENEKGIENEK_SIM_H
+#define ZENEKGIENEK_SIM_H
+
+#include "entities.h"
+#include "grid.h"
+#include "jobs.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Gameplay simulation of the main gamestate. It doesn't touch Allegro at all and
+// only advances in fixed steps, so given the same seed and the same commands
+// at the same ticks it always ends up in the same state.
+
+#define SIM_TICKS_PER_SECOND 60
+#define SIM_TICK (1.0 / SIM_TICKS_PER_SECOND)
+#define SIM_WORLD_SIZE 8192
+#define SIM_MAX_FAKES 64
+#define SIM_CHUNK 2048 // entities per job when a phase is split across threads
+
+enum SIM_INPUT {
+	SIM_INPUT_LEFT = 1 << 0,
+	SIM_INPUT_RIGHT = 1 << 1,
+	SIM_INPUT_UP = 1 << 2,
+	SIM_INPUT_DOWN = 1 << 3
+};
+
+enum SIM_COMMAND_TYPE {
+	SIM_COMMAND_INPUT, // arg: SIM_INPUT_* mask of held keys
+	SIM_COMMAND_FIRE,
+	SIM_COMMAND_START,
+	SIM_COMMAND_SPAWN_WAVE,
+	SIM_COMMAND_SPAWN_FAKE,
+	SIM_COMMAND_SPAWN_ENEMY
+};
+
+struct SimCommand {
+	enum SIM_COMMAND_TYPE type;
+	int arg;
+};
+
+struct SpawnBuffer;
+
+struct Sim {
+	double x, y, angle;
+	int score;
+	int fake_counter;
+
+	int tick;
+	int fade, pew, tilt;
+	bool started, spawning, ended;
+	bool endless; // never end the game because of fake news, for stress testing
+	bool failed; // something got dropped for lack of memory, so it no longer plays out like it should
+	int input;
+
+	int explosions; // number of entities blown up during the last step
+
+	uint64_t rng;
+
+	struct EntityPool* entities;
+	struct Grid* grid;
+
+	struct SimCommand* commands; // queued for the next step
+	int commands_count, commands_capacity;
+
+	struct JobPool* jobs; // not owned; NULL runs every phase on the calling thread
+	struct SpawnBuffer* spawns; // one per job worker, plus one to merge them into
+	int spawns_count;
+};
+
+struct Sim* CreateSim(uint64_t seed);
+void DestroySim(struct Sim* sim);
+void SimQueueCommand(struct Sim* sim, enum SIM_COMMAND_TYPE type, int arg);
+int SimSpawn(struct Sim* sim, double x, double y, double angle, enum ENTITY_TYPE type);
+// Splits movement, wandering and explosion timers into chunks of SIM_CHUNK
+// entities run on the given pool. Results don't depend on the number of threads.
+void SetSimJobs(struct Sim* sim, struct JobPool* jobs);
+
+// Advances the simulation by a single tick. Equivalent to calling SimBeginStep
+// and then, if it returned true, SimMoveBullets, SimCollide, SimMoveWanderers
+// and SimWander in this order; the phases are exposed separately so they can be
+// measured on their own. Wandering entities get hit where they were before moving.
+void SimStep(struct Sim* sim);
+bool SimBeginStep(struct Sim* sim); // commands, player, counters and explosion timers
+void SimMoveBullets(struct Sim* sim);
+void SimCollide(struct Sim* sim); // player and bullets against everything hittable
+void SimMoveWanderers(struct Sim* sim);
+void SimWander(struct Sim* sim); // picking new directions and leaving fakes/messages behind
+
+#endif
@@ -0,0 +1,320 @@
+/*! \file simworker.c
+ *  \brief Gameplay simulation running on a worker thread.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "simworker.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+// realloc that leaves the old buffer in place when it fails
+static bool Grow(void** ptr, size_t size) {
+	void* grown = realloc(*ptr, size);
+	if (grown) {
+		*ptr = grown;
+	}
+	return grown;
+}
+
+static bool GrowHistory(struct SimWorker* worker, int capacity) {
+	if (capacity <= worker->history.capacity) {
+		return true;
+	}
+	bool ok = Grow((void**)&worker->history.x, sizeof(double) * capacity);
+	ok = Grow((void**)&worker->history.y, sizeof(double) * capacity) && ok;
+	ok = Grow((void**)&worker->history.tick, sizeof(int) * capacity) && ok;
+	ok = Grow((void**)&worker->history.type, sizeof(enum ENTITY_TYPE) * capacity) && ok;
+	if (!ok) {
+		return false;
+	}
+	for (int i = worker->history.capacity; i < capacity; i++) {
+		worker->history.tick[i] = -1;
+	}
+	worker->history.capacity = capacity;
+	return true;
+}
+
+static bool CopyList(struct SimWorker* worker, struct SimFrameList* dst, const struct EntityList* src, enum ENTITY_TYPE type, bool continuous) {
+	if (src->count > dst->capacity) {
+		int capacity = src->capacity;
+		bool ok = Grow((void**)&dst->x, sizeof(double) * capacity);
+		ok = Grow((void**)&dst->y, sizeof(double) * capacity) && ok;
+		ok = Grow((void**)&dst->prev_x, sizeof(double) * capacity) && ok;
+		ok = Grow((void**)&dst->prev_y, sizeof(double) * capacity) && ok;
+		ok = Grow((void**)&dst->score, sizeof(int) * capacity) && ok;
+		ok = Grow((void**)&dst->id, sizeof(int) * capacity) && ok;
+		if (!ok) {
+			dst->count = 0;
+			return false;
+		}
+		dst->capacity = capacity;
+	}
+	dst->count = src->count;
+	if (!src->count) {
+		return true;
+	}
+	memcpy(dst->x, src->x, sizeof(double) * src->count);
+	memcpy(dst->y, src->y, sizeof(double) * src->count);
+	memcpy(dst->score, src->score, sizeof(int) * src->count);
+	memcpy(dst->id, src->id, sizeof(int) * src->count);
+
+	// an id seen a tick ago with the same type is the same entity, so it can
+	// be drawn in between; anything else appears right where it is
+	int tick = worker->sim->tick;
+	for (int i = 0; i < src->count; i++) {
+		int id = src->id[i];
+		if (continuous && (worker->history.tick[id] == tick - 1) && (worker->history.type[id] == type)) {
+			dst->prev_x[i] = worker->history.x[id];
+			dst->prev_y[i] = worker->history.y[id];
+		} else {
+			dst->prev_x[i] = src->x[i];
+			dst->prev_y[i] = src->y[i];
+		}
+	}
+	return true;
+}
+
+// Remembers where everything is for the next frame. Done after all the lists
+// are copied, since an entity can only be in one of them.
+static void RecordHistory(struct SimWorker* worker) {
+	struct Sim* sim = worker->sim;
+	for (enum ENTITY_TYPE type = 0; type < TYPE_COUNT; type++) {
+		struct EntityList* list = &sim->entities->lists[type];
+		for (int i = 0; i < list->count; i++) {
+			int id = list->id[i];
+			worker->history.x[id] = list->x[i];
+			worker->history.y[id] = list->y[i];
+			worker->history.tick[id] = sim->tick;
+			worker->history.type[id] = type;
+		}
+	}
+	worker->history.px = sim->x;
+	worker->history.py = sim->y;
+	worker->history.pangle = sim->angle;
+}
+
+// Without `continuous`, nothing gets interpolated from the previous frame.
+static void FillFrame(struct SimWorker* worker, struct SimFrame* frame, bool continuous) {
+	struct Sim* sim = worker->sim;
+	// every id is below id_capacity, so a single check covers them all
+	continuous = GrowHistory(worker, sim->entities->id_capacity) && continuous;
+	frame->x = sim->x;
+	frame->y = sim->y;
+	frame->angle = sim->angle;
+	frame->prev_x = continuous ? worker->history.px : sim->x;
+	frame->prev_y = continuous ? worker->history.py : sim->y;
+	frame->prev_angle = continuous ? worker->history.pangle : sim->angle;
+	frame->steps = worker->steps;
+	frame->score = sim->score;
+	frame->fake_counter = sim->fake_counter;
+	frame->tick = sim->tick;
+	frame->fade = sim->fade;
+	frame->pew = sim->pew;
+	frame->tilt = sim->tilt;
+	frame->started = sim->started;
+	frame->ended = sim->ended;
+	frame->failed = sim->failed;
+	frame->explosions = worker->explosions;
+	for (enum ENTITY_TYPE type = 0; type < TYPE_COUNT; type++) {
+		CopyList(worker, &frame->lists[type], &sim->entities->lists[type], type, continuous);
+	}
+	if (worker->history.capacity >= sim->entities->id_capacity) {
+		RecordHistory(worker);
+	}
+}
+
+// Called with the mutex held, if there's one.
+static void Publish(struct SimWorker* worker) {
+	int ready = worker->ready;
+	worker->ready = worker->back;
+	worker->back = ready;
+	worker->fresh = true;
+}
+
+// Hands the commands due after `steps` ticks to the sim. Called with the mutex
+// held, if there's one.
+static void MoveCommands(struct SimWorker* worker, int steps) {
+	int i = 0;
+	for (; (i < worker->commands_count) && (worker->commands[i].at <= steps); i++) {
+		SimQueueCommand(worker->sim, worker->commands[i].command.type, worker->commands[i].command.arg);
+	}
+	if (i) {
+		worker->commands_count -= i;
+		memmove(worker->commands, worker->commands + i, sizeof(struct SimWorkerCommand) * worker->commands_count);
+	}
+}
+
+static void Tick(struct SimWorker* worker) {
+	SimStep(worker->sim);
+	worker->explosions += worker->sim->explosions;
+	worker->steps++;
+	FillFrame(worker, &worker->frames[worker->back], true);
+}
+
+static void* Worker(ALLEGRO_THREAD* thread, void* arg) {
+	struct SimWorker* worker = arg;
+	al_lock_mutex(worker->mutex);
+	while (!al_get_thread_should_stop(thread)) {
+		if (!worker->ticks) {
+			worker->busy = false;
+			al_broadcast_cond(worker->cond);
+			al_wait_cond(worker->cond, worker->mutex);
+			continue;
+		}
+
+		worker->ticks--;
+		worker->busy = true;
+		MoveCommands(worker, worker->steps);
+		al_unlock_mutex(worker->mutex);
+		Tick(worker);
+		al_lock_mutex(worker->mutex);
+		Publish(worker);
+	}
+	worker->busy = false;
+	al_unlock_mutex(worker->mutex);
+	return NULL;
+}
+
+struct SimWorker* CreateSimWorker(struct Sim* sim) {
+	struct SimWorker* worker = calloc(1, sizeof(struct SimWorker));
+	worker->sim = sim;
+	worker->back = 0;
+	worker->ready = 1;
+	worker->front = 2;
+	FillFrame(worker, &worker->frames[worker->front], false);
+#ifndef __EMSCRIPTEN__
+	worker->mutex = al_create_mutex();
+	worker->cond = al_create_cond();
+	worker->thread = al_create_thread(Worker, worker);
+	if (worker->thread) {
+		al_start_thread(worker->thread);
+	}
+#endif
+	return worker;
+}
+
+void DestroySimWorker(struct SimWorker* worker) {
+	if (worker->thread) {
+		al_lock_mutex(worker->mutex);
+		al_set_thread_should_stop(worker->thread);
+		al_broadcast_cond(worker->cond);
+		al_unlock_mutex(worker->mutex);
+		al_join_thread(worker->thread, NULL);
+		al_destroy_thread(worker->thread);
+	}
+	if (worker->mutex) {
+		al_destroy_mutex(worker->mutex);
+		al_destroy_cond(worker->cond);
+	}
+	for (int i = 0; i < 3; i++) {
+		for (enum ENTITY_TYPE type = 0; type < TYPE_COUNT; type++) {
+			free(worker->frames[i].lists[type].x);
+			free(worker->frames[i].lists[type].y);
+			free(worker->frames[i].lists[type].prev_x);
+			free(worker->frames[i].lists[type].prev_y);
+			free(worker->frames[i].lists[type].score);
+			free(worker->frames[i].lists[type].id);
+		}
+	}
+	DestroySim(worker->sim);
+	free(worker->history.x);
+	free(worker->history.y);
+	free(worker->history.tick);
+	free(worker->history.type);
+	free(worker->commands);
+	free(worker);
+}
+
+void QueueSimCommand(struct SimWorker* worker, enum SIM_COMMAND_TYPE type, int arg) {
+	if (!worker->thread) {
+		SimQueueCommand(worker->sim, type, arg);
+		return;
+	}
+	al_lock_mutex(worker->mutex);
+	if (worker->commands_count == worker->commands_capacity) {
+		int capacity = worker->commands_capacity ? worker->commands_capacity * 2 : 16;
+		struct SimWorkerCommand* commands = realloc(worker->commands, sizeof(struct SimWorkerCommand) * capacity);
+		if (!commands) {
+			al_unlock_mutex(worker->mutex);
+			return;
+		}
+		worker->commands = commands;
+		worker->commands_capacity = capacity;
+	}
+	worker->commands[worker->commands_count++] = (struct SimWorkerCommand){.command = {.type = type, .arg = arg}, .at = worker->requested};
+	al_unlock_mutex(worker->mutex);
+}
+
+void AdvanceSim(struct SimWorker* worker, int ticks) {
+	if (ticks <= 0) {
+		return;
+	}
+	worker->requested += ticks;
+	if (!worker->thread) {
+		for (int i = 0; i < ticks; i++) {
+			Tick(worker);
+			Publish(worker);
+		}
+		return;
+	}
+	al_lock_mutex(worker->mutex);
+	worker->ticks += ticks;
+	al_broadcast_cond(worker->cond);
+	al_unlock_mutex(worker->mutex);
+}
+
+const struct SimFrame* TakeSimFrame(struct SimWorker* worker) {
+	if (worker->thread) {
+		al_lock_mutex(worker->mutex);
+	}
+	if (worker->fresh) {
+		int front = worker->front;
+		worker->front = worker->ready;
+		worker->ready = front;
+		worker->fresh = false;
+	}
+	if (worker->thread) {
+		al_unlock_mutex(worker->mutex);
+	}
+	return &worker->frames[worker->front];
+}
+
+struct Sim* SyncSim(struct SimWorker* worker) {
+	if (worker->thread) {
+		al_lock_mutex(worker->mutex);
+		while (worker->ticks || worker->busy) {
+			al_wait_cond(worker->cond, worker->mutex);
+		}
+		MoveCommands(worker, INT_MAX);
+		al_unlock_mutex(worker->mutex);
+	}
+	return worker->sim;
+}
+
+void PublishSimFrame(struct SimWorker* worker) {
+	SyncSim(worker);
+	FillFrame(worker, &worker->frames[worker->back], false);
+	if (worker->thread) {
+		al_lock_mutex(worker->mutex);
+	}
+	Publish(worker);
+	if (worker->thread) {
+		al_unlock_mutex(worker->mutex);
+	}
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZENEKGIENEK_SIMWORKER_H
+#define ZENEKGIENEK_SIMWORKER_H
+
+#include "sim.h"
+#include <libsuperderpy.h>
+
+// Runs the gameplay simulation on its own thread, so that a heavy tick and
+// a heavy frame overlap instead of adding up. After every tick the worker
+// publishes a SimFrame with everything needed to draw it; frames are triple
+// buffered, so neither side ever waits for the other. Web builds have no
+// worker and run the ticks right away instead.
+
+// Entities of a single type, as they were at the end of a tick. `prev_x` and
+// `prev_y` are where they were a tick before, for drawing in between; entities
+// that weren't there (or had another type) have them equal to x and y.
+struct SimFrameList {
+	double *x, *y;
+	double *prev_x, *prev_y;
+	int *score, *id;
+	int count, capacity;
+};
+
+struct SimFrame {
+	double x, y, angle;
+	double prev_x, prev_y, prev_angle;
+	int steps; // ticks run by the worker so far, to be compared with SimWorker.requested
+	int score, fake_counter;
+	int tick, fade, pew, tilt;
+	bool started, ended;
+	bool failed; // see Sim.failed
+	int explosions; // blown up since the worker was created, to be compared with an earlier frame
+	struct SimFrameList lists[TYPE_COUNT];
+};
+
+struct SimWorkerCommand {
+	struct SimCommand command;
+	int at; // ticks requested when it was queued; it's run right after that many
+};
+
+struct SimWorker {
+	struct Sim* sim; // only touched by the worker, unless synced with SyncSim
+	struct SimFrame frames[3];
+	int back, ready, front; // written by the worker, last published, being read
+	bool fresh; // `ready` hasn't been taken yet
+	int explosions;
+	int steps;
+	int requested; // only touched by the caller
+
+	struct {
+		double *x, *y;
+		int *tick; // when the id was last seen
+		enum ENTITY_TYPE* type;
+		int capacity;
+		double px, py, pangle; // the player
+	} history; // positions from the last filled frame, by id
+
+	struct SimWorkerCommand* commands; // not handed to the sim yet
+	int commands_count, commands_capacity;
+	int ticks; // requested, but not run yet
+	bool busy;
+
+	ALLEGRO_THREAD* thread;
+	ALLEGRO_MUTEX* mutex;
+	ALLEGRO_COND* cond;
+};
+
+// The worker takes over the sim and destroys it along with itself.
+struct SimWorker* CreateSimWorker(struct Sim* sim);
+void DestroySimWorker(struct SimWorker* worker);
+// Same as SimQueueCommand, but safe to call while the worker is busy. The
+// command takes effect after all the ticks requested so far, even if the worker
+// hasn't got to them yet, so the result doesn't depend on its timing.
+void QueueSimCommand(struct SimWorker* worker, enum SIM_COMMAND_TYPE type, int arg);
+// Requests the given number of ticks and returns without waiting for them.
+void AdvanceSim(struct SimWorker* worker, int ticks);
+// Returns the latest published frame. It stays valid (and unchanged) until
+// the next call.
+const struct SimFrame* TakeSimFrame(struct SimWorker* worker);
+// Waits for all requested ticks to finish and hands the sim over, with all
+// queued commands moved into it, until the next AdvanceSim call. Call
+// PublishSimFrame afterwards if it was modified; the published frame doesn't
+// interpolate from whatever was there before.
+struct Sim* SyncSim(struct SimWorker* worker);
+void PublishSimFrame(struct SimWorker* worker);
+
+#endif
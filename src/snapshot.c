@@ -0,0 +1,267 @@
+/*! \file snapshot.c
+ *  \brief Saving and restoring the whole simulation state.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// entity lists store score and id as int
+_Static_assert(sizeof(int) == sizeof(int32_t), "int has to be 32-bit");
+
+#define SNAPSHOT_ENTITY_SIZE (6 * sizeof(double) + 2 * sizeof(int32_t))
+
+size_t GetSimSnapshotSize(const struct Sim* sim, size_t extra_size) {
+	const struct EntityPool* pool = sim->entities;
+	return sizeof(struct SimSnapshotHeader) + pool->count * SNAPSHOT_ENTITY_SIZE +
+		pool->free_count * sizeof(int32_t) + sim->commands_count * 2 * sizeof(int32_t) + extra_size;
+}
+
+static void Put(unsigned char** p, const void* data, size_t size) {
+	memcpy(*p, data, size);
+	*p += size;
+}
+
+static void Get(const unsigned char** p, void* data, size_t size) {
+	memcpy(data, *p, size);
+	*p += size;
+}
+
+size_t SaveSimSnapshot(const struct Sim* sim, const void* extra, size_t extra_size, void* buffer, size_t size) {
+	size_t needed = GetSimSnapshotSize(sim, extra_size);
+	if (size < needed) {
+		return 0;
+	}
+	const struct EntityPool* pool = sim->entities;
+	struct SimSnapshotHeader header = {
+		.magic = SIM_SNAPSHOT_MAGIC,
+		.version = SIM_SNAPSHOT_VERSION,
+		.extra_size = extra_size,
+		.rng = sim->rng,
+		.x = sim->x,
+		.y = sim->y,
+		.angle = sim->angle,
+		.score = sim->score,
+		.fake_counter = sim->fake_counter,
+		.tick = sim->tick,
+		.fade = sim->fade,
+		.pew = sim->pew,
+		.tilt = sim->tilt,
+		.input = sim->input,
+		.explosions = sim->explosions,
+		.started = sim->started,
+		.spawning = sim->spawning,
+		.ended = sim->ended,
+		.endless = sim->endless,
+		.id_capacity = pool->id_capacity,
+		.free_count = pool->free_count,
+		.commands_count = sim->commands_count,
+	};
+	for (int i = 0; i < TYPE_COUNT; i++) {
+		header.counts[i] = pool->lists[i].count;
+	}
+
+	unsigned char* p = buffer;
+	Put(&p, &header, sizeof(header));
+	for (int i = 0; i < TYPE_COUNT; i++) {
+		const struct EntityList* list = &pool->lists[i];
+		Put(&p, list->x, sizeof(double) * list->count);
+		Put(&p, list->y, sizeof(double) * list->count);
+		Put(&p, list->angle, sizeof(double) * list->count);
+		Put(&p, list->distance, sizeof(double) * list->count);
+		Put(&p, list->dx, sizeof(double) * list->count);
+		Put(&p, list->dy, sizeof(double) * list->count);
+		Put(&p, list->score, sizeof(int32_t) * list->count);
+		Put(&p, list->id, sizeof(int32_t) * list->count);
+	}
+	Put(&p, pool->free_ids, sizeof(int32_t) * pool->free_count);
+	for (int i = 0; i < sim->commands_count; i++) {
+		int32_t command[2] = {sim->commands[i].type, sim->commands[i].arg};
+		Put(&p, command, sizeof(command));
+	}
+	if (extra_size) {
+		Put(&p, extra, extra_size);
+	}
+	return needed;
+}
+
+// Checks that the header describes exactly `size` bytes and that every id is
+// used exactly once, either by an entity or by the free list.
+static bool Validate(const struct SimSnapshotHeader* header, const unsigned char* data, size_t size) {
+	if ((memcmp(header->magic, SIM_SNAPSHOT_MAGIC, sizeof(header->magic)) != 0) || (header->version != SIM_SNAPSHOT_VERSION)) {
+		return false;
+	}
+	if ((header->id_capacity < 1) || (header->free_count < 0) || (header->commands_count < 0)) {
+		return false;
+	}
+	uint64_t entities = 0;
+	for (int i = 0; i < TYPE_COUNT; i++) {
+		if (header->counts[i] < 0) {
+			return false;
+		}
+		entities += header->counts[i];
+	}
+	if (entities + header->free_count != (uint64_t)header->id_capacity) {
+		return false;
+	}
+	uint64_t expected = sizeof(*header) + entities * SNAPSHOT_ENTITY_SIZE + (uint64_t)header->free_count * sizeof(int32_t) +
+		(uint64_t)header->commands_count * 2 * sizeof(int32_t) + header->extra_size;
+	if (expected != size) {
+		return false;
+	}
+
+	bool* seen = calloc(header->id_capacity, sizeof(bool));
+	if (!seen) {
+		return false;
+	}
+	bool valid = true;
+	const unsigned char* p = data + sizeof(*header);
+	for (int i = 0; i < TYPE_COUNT && valid; i++) {
+		p += header->counts[i] * 6 * sizeof(double) + header->counts[i] * sizeof(int32_t);
+		for (int j = 0; j < header->counts[i] && valid; j++) {
+			int32_t id;
+			Get(&p, &id, sizeof(id));
+			valid = (id >= 0) && (id < header->id_capacity) && !seen[id];
+			if (valid) {
+				seen[id] = true;
+			}
+		}
+	}
+	for (int j = 0; j < header->free_count && valid; j++) {
+		int32_t id;
+		Get(&p, &id, sizeof(id));
+		valid = (id >= 0) && (id < header->id_capacity) && !seen[id];
+		if (valid) {
+			seen[id] = true;
+		}
+	}
+	free(seen);
+	return valid;
+}
+
+bool RestoreSimSnapshot(struct Sim* sim, const void* buffer, size_t size, void* extra, size_t extra_size) {
+	struct SimSnapshotHeader header;
+	if (size < sizeof(header)) {
+		return false;
+	}
+	memcpy(&header, buffer, sizeof(header));
+	if (!Validate(&header, buffer, size)) {
+		return false;
+	}
+
+	struct EntityPool* pool = sim->entities;
+	if (!ReserveEntityPool(pool, header.counts, header.id_capacity)) {
+		return false;
+	}
+	if (header.commands_count > sim->commands_capacity) {
+		struct SimCommand* commands = realloc(sim->commands, sizeof(struct SimCommand) * header.commands_count);
+		if (!commands) {
+			return false;
+		}
+		sim->commands = commands;
+		sim->commands_capacity = header.commands_count;
+	}
+	if ((header.id_capacity > sim->grid->capacity) && !ResizeGrid(sim->grid, header.id_capacity)) {
+		return false;
+	}
+	// nothing can fail from here on
+	pool->id_capacity = header.id_capacity;
+
+	const unsigned char* p = (const unsigned char*)buffer + sizeof(header);
+	pool->count = 0;
+	for (int i = 0; i < TYPE_COUNT; i++) {
+		struct EntityList* list = &pool->lists[i];
+		list->count = header.counts[i];
+		Get(&p, list->x, sizeof(double) * list->count);
+		Get(&p, list->y, sizeof(double) * list->count);
+		Get(&p, list->angle, sizeof(double) * list->count);
+		Get(&p, list->distance, sizeof(double) * list->count);
+		Get(&p, list->dx, sizeof(double) * list->count);
+		Get(&p, list->dy, sizeof(double) * list->count);
+		Get(&p, list->score, sizeof(int32_t) * list->count);
+		Get(&p, list->id, sizeof(int32_t) * list->count);
+		for (int j = 0; j < list->count; j++) {
+			pool->refs[list->id[j]] = (struct EntityRef){.type = i, .index = j};
+		}
+		pool->count += list->count;
+	}
+	pool->free_count = header.free_count;
+	Get(&p, pool->free_ids, sizeof(int32_t) * pool->free_count);
+	sim->commands_count = header.commands_count;
+	for (int i = 0; i < sim->commands_count; i++) {
+		int32_t command[2];
+		Get(&p, command, sizeof(command));
+		sim->commands[i] = (struct SimCommand){.type = command[0], .arg = command[1]};
+	}
+	if (extra && (extra_size == header.extra_size)) {
+		memcpy(extra, p, extra_size);
+	}
+
+	sim->rng = header.rng;
+	sim->x = header.x;
+	sim->y = header.y;
+	sim->angle = header.angle;
+	sim->score = header.score;
+	sim->fake_counter = header.fake_counter;
+	sim->tick = header.tick;
+	sim->fade = header.fade;
+	sim->pew = header.pew;
+	sim->tilt = header.tilt;
+	sim->input = header.input;
+	sim->explosions = header.explosions;
+	sim->started = header.started;
+	sim->spawning = header.spawning;
+	sim->ended = header.ended;
+	sim->endless = header.endless;
+	sim->failed = false; // everything is as it was saved now
+	return true;
+}
+
+bool WriteSnapshotFile(const char* path, const void* buffer, size_t size) {
+	FILE* file = fopen(path, "wb");
+	if (!file) {
+		return false;
+	}
+	bool ok = fwrite(buffer, 1, size, file) == size;
+	return (fclose(file) == 0) && ok;
+}
+
+void* ReadSnapshotFile(const char* path, size_t* size) {
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		return NULL;
+	}
+	void* data = NULL;
+	long length = -1;
+	if (fseek(file, 0, SEEK_END) == 0) {
+		length = ftell(file);
+	}
+	if ((length > 0) && (fseek(file, 0, SEEK_SET) == 0)) {
+		data = malloc(length);
+		if (data && (fread(data, 1, length, file) == (size_t)length)) {
+			*size = length;
+		} else {
+			free(data);
+			data = NULL;
+		}
+	}
+	fclose(file);
+	return data;
+}
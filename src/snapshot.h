@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZENEKGIENEK_SNAPSHOT_H
+#define ZENEKGIENEK_SNAPSHOT_H
+
+#include "sim.h"
+#include <stddef.h>
+
+// Complete state of a Sim in one flat buffer, so that it can be restored
+// (from memory or from a file) and continue exactly as it would have. Callers
+// can store a blob of their own state along with it.
+//
+// Layout: SimSnapshotHeader; for every entity type, `counts[type]` values of
+// x, y, angle, distance, dx, dy (doubles), score and id (int32_t) one array
+// after another; `free_count` free ids; `commands_count` (type, arg) pairs of
+// int32_t; `extra_size` bytes of caller's data.
+
+#define SIM_SNAPSHOT_MAGIC "ZGSIMv1"
+#define SIM_SNAPSHOT_VERSION 1
+
+struct SimSnapshotHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t extra_size;
+	uint64_t rng;
+	double x, y, angle;
+	int32_t score, fake_counter;
+	int32_t tick, fade, pew, tilt, input, explosions;
+	uint8_t started, spawning, ended, endless;
+	int32_t counts[TYPE_COUNT];
+	int32_t id_capacity, free_count;
+	int32_t commands_count;
+};
+
+size_t GetSimSnapshotSize(const struct Sim* sim, size_t extra_size);
+// Returns the number of bytes written, or 0 if the buffer is too small.
+size_t SaveSimSnapshot(const struct Sim* sim, const void* extra, size_t extra_size, void* buffer, size_t size);
+// Leaves the sim untouched when the snapshot is invalid. Extra data is only
+// copied out when its size matches; it's also fine to pass NULL.
+bool RestoreSimSnapshot(struct Sim* sim, const void* buffer, size_t size, void* extra, size_t extra_size);
+
+bool WriteSnapshotFile(const char* path, const void* buffer, size_t size);
+// Returns a malloc'ed buffer or NULL.
+void* ReadSnapshotFile(const char* path, size_t* size);
+
+#endif
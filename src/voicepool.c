@@ -0,0 +1,236 @@
+/*! \file voicepool.c
+ *  \brief Background loading of voice line streams.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "voicepool.h"
+#include "assetpack.h"
+#include <stdlib.h>
+#include <string.h>
+
+enum REQUEST_STATE {
+	REQUEST_QUEUED,
+	REQUEST_LOADING,
+	REQUEST_READY,
+	REQUEST_FAILED,
+	REQUEST_CANCELLED // while the worker is still busy opening it
+};
+
+struct VoiceRequest {
+	char* filename;
+	char* path;
+	enum REQUEST_STATE state;
+	ALLEGRO_AUDIO_STREAM* stream;
+	struct VoiceRequest* next;
+};
+
+static ALLEGRO_AUDIO_STREAM* OpenStream(const char* path) {
+	ALLEGRO_AUDIO_STREAM* stream = al_load_audio_stream(path, 4, 1024);
+	if (stream) {
+		al_set_audio_stream_playing(stream, false);
+		al_set_audio_stream_playmode(stream, ALLEGRO_PLAYMODE_ONCE);
+	}
+	return stream;
+}
+
+static void Unlink(struct VoicePool* pool, struct VoiceRequest* request) {
+	struct VoiceRequest* prev = NULL;
+	for (struct VoiceRequest* r = pool->first; r; prev = r, r = r->next) {
+		if (r == request) {
+			if (prev) {
+				prev->next = r->next;
+			} else {
+				pool->first = r->next;
+			}
+			if (pool->last == r) {
+				pool->last = prev;
+			}
+			break;
+		}
+	}
+	free(request->filename);
+	free(request->path);
+	free(request);
+}
+
+static struct VoiceRequest* Find(struct VoicePool* pool, const char* filename) {
+	for (struct VoiceRequest* r = pool->first; r; r = r->next) {
+		if ((r->state != REQUEST_CANCELLED) && (strcmp(r->filename, filename) == 0)) {
+			return r;
+		}
+	}
+	return NULL;
+}
+
+static void* Worker(ALLEGRO_THREAD* thread, void* arg) {
+	struct VoicePool* pool = arg;
+	UseAssetPack();
+	al_lock_mutex(pool->mutex);
+	while (!al_get_thread_should_stop(thread)) {
+		struct VoiceRequest* request = NULL;
+		if (pool->open < pool->ahead) {
+			for (struct VoiceRequest* r = pool->first; r; r = r->next) {
+				if (r->state == REQUEST_QUEUED) {
+					request = r;
+					break;
+				}
+			}
+		}
+		if (!request) {
+			al_wait_cond(pool->cond, pool->mutex);
+			continue;
+		}
+
+		request->state = REQUEST_LOADING;
+		pool->open++;
+		al_unlock_mutex(pool->mutex);
+		ALLEGRO_AUDIO_STREAM* stream = OpenStream(request->path);
+		al_lock_mutex(pool->mutex);
+
+		if (request->state == REQUEST_CANCELLED) {
+			if (stream) {
+				al_destroy_audio_stream(stream);
+			}
+			pool->open--;
+			Unlink(pool, request);
+		} else if (stream) {
+			request->stream = stream;
+			request->state = REQUEST_READY;
+		} else {
+			PrintConsole(pool->game, "Couldn't load voice %s!", request->path);
+			request->state = REQUEST_FAILED;
+			pool->open--;
+		}
+	}
+	al_unlock_mutex(pool->mutex);
+	return NULL;
+}
+
+struct VoicePool* CreateVoicePool(struct Game* game, int ahead) {
+	struct VoicePool* pool = calloc(1, sizeof(struct VoicePool));
+	pool->game = game;
+	pool->ahead = ahead;
+#ifndef __EMSCRIPTEN__
+	pool->mutex = al_create_mutex();
+	pool->cond = al_create_cond();
+	pool->thread = al_create_thread(Worker, pool);
+	if (pool->thread) {
+		al_start_thread(pool->thread);
+	}
+#endif
+	return pool;
+}
+
+void DestroyVoicePool(struct VoicePool* pool) {
+	if (pool->thread) {
+		al_lock_mutex(pool->mutex);
+		al_set_thread_should_stop(pool->thread);
+		al_broadcast_cond(pool->cond);
+		al_unlock_mutex(pool->mutex);
+		al_join_thread(pool->thread, NULL);
+		al_destroy_thread(pool->thread);
+	}
+	while (pool->first) {
+		if (pool->first->stream) {
+			al_destroy_audio_stream(pool->first->stream);
+		}
+		Unlink(pool, pool->first);
+	}
+	if (pool->mutex) {
+		al_destroy_mutex(pool->mutex);
+		al_destroy_cond(pool->cond);
+	}
+	free(pool);
+}
+
+void RequestVoice(struct VoicePool* pool, const char* filename) {
+	struct VoiceRequest* request = calloc(1, sizeof(struct VoiceRequest));
+	request->filename = strdup(filename);
+	request->path = strdup(GetDataFilePath(pool->game, filename));
+	request->state = REQUEST_QUEUED;
+
+	if (pool->thread) {
+		al_lock_mutex(pool->mutex);
+	}
+	if (pool->last) {
+		pool->last->next = request;
+	} else {
+		pool->first = request;
+	}
+	pool->last = request;
+	if (pool->thread) {
+		al_signal_cond(pool->cond);
+		al_unlock_mutex(pool->mutex);
+	}
+}
+
+enum VOICE_STATUS TakeVoice(struct VoicePool* pool, const char* filename, ALLEGRO_AUDIO_STREAM** stream) {
+	*stream = NULL;
+
+	if (!pool->thread) {
+		struct VoiceRequest* request = Find(pool, filename);
+		if (!request) {
+			return VOICE_FAILED;
+		}
+		*stream = OpenStream(request->path);
+		Unlink(pool, request);
+		return *stream ? VOICE_READY : VOICE_FAILED;
+	}
+
+	enum VOICE_STATUS status = VOICE_PENDING;
+	al_lock_mutex(pool->mutex);
+	struct VoiceRequest* request = Find(pool, filename);
+	if (!request || (request->state == REQUEST_FAILED)) {
+		status = VOICE_FAILED;
+	} else if (request->state == REQUEST_READY) {
+		*stream = request->stream;
+		status = VOICE_READY;
+		pool->open--;
+	}
+	if (status != VOICE_PENDING) {
+		if (request) {
+			Unlink(pool, request);
+		}
+		al_signal_cond(pool->cond);
+	}
+	al_unlock_mutex(pool->mutex);
+	return status;
+}
+
+void CancelVoice(struct VoicePool* pool, const char* filename) {
+	if (pool->thread) {
+		al_lock_mutex(pool->mutex);
+	}
+	struct VoiceRequest* request = Find(pool, filename);
+	if (request) {
+		if (request->state == REQUEST_LOADING) {
+			// the worker cleans it up once it's done
+			request->state = REQUEST_CANCELLED;
+		} else {
+			if (request->state == REQUEST_READY) {
+				al_destroy_audio_stream(request->stream);
+				pool->open--;
+			}
+			Unlink(pool, request);
+		}
+	}
+	if (pool->thread) {
+		al_signal_cond(pool->cond);
+		al_unlock_mutex(pool->mutex);
+	}
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZENEKGIENEK_VOICEPOOL_H
+#define ZENEKGIENEK_VOICEPOOL_H
+
+#include <libsuperderpy.h>
+
+// Opens voice line streams on a worker thread, in the order they were
+// requested, keeping at most a given number of them opened ahead of time.
+// Requests are identified by their file name; when the same file is requested
+// more than once, the oldest request is the one that gets taken or cancelled.
+
+enum VOICE_STATUS {
+	VOICE_PENDING, // not opened yet, try again later
+	VOICE_READY,
+	VOICE_FAILED
+};
+
+struct VoiceRequest;
+
+struct VoicePool {
+	struct Game* game;
+	int ahead; // maximum number of opened streams waiting to be taken
+	int open;
+	struct VoiceRequest *first, *last;
+	ALLEGRO_THREAD* thread;
+	ALLEGRO_MUTEX* mutex;
+	ALLEGRO_COND* cond;
+};
+
+struct VoicePool* CreateVoicePool(struct Game* game, int ahead);
+void DestroyVoicePool(struct VoicePool* pool);
+void RequestVoice(struct VoicePool* pool, const char* filename);
+// Never blocks (unless there's no worker thread, as in web builds). The stream
+// handed out with VOICE_READY belongs to the caller from then on. Unless it
+// returned VOICE_PENDING, the request is done with and must not be cancelled,
+// or a later request for the same file would get cancelled instead.
+enum VOICE_STATUS TakeVoice(struct VoicePool* pool, const char* filename, ALLEGRO_AUDIO_STREAM** stream);
+void CancelVoice(struct VoicePool* pool, const char* filename);
+
+#endif